@@ -3,12 +3,15 @@
 #define __AABB_H__
 
 #include <shape.h>
+#include "slab.h"
 
-class AABB : public Shape {
+class AABB final : public Shape {
 private:
     Vector3D minPoint = Vector3D(-INFINITY);
     Vector3D maxPoint = Vector3D(INFINITY);
 
+    bool findT(const InverseRay& ray, float far, float& t) const;
+
 public:
     AABB();
     AABB(const Vector3D& minPoint_, const Vector3D& maxPoint_, const Color& color, float reflectivity, float transparency, float refractiveIndex);
@@ -16,8 +19,55 @@ public:
     void setMinPoint(const Vector3D& point);
     void setMaxPoint(const Vector3D& point);
 
-    bool intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const override;
+    bool intersect(Hit* hit, const Ray& ray, float far) const override;
+    Intersect getIntersect(const Hit& hit, const Ray& ray) const override;
+    bool occluded(Shape** occludingShape, const Ray& ray, float far) const override;
     void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const override;
 };
 
+// The intersection kernels are defined in the header, so that meshes can inline them into their traversal
+
+// Finds the distance to the closest intersection point in (0, far) if the ray intersects the AABB
+// Branchless slab test, the clamped reciprocal direction keeps the slabs of the axes that the ray is parallel to 
+// at infinite distances, so they only cut off the rays whose origins are outside them
+inline bool AABB::findT(const InverseRay& ray, float far, float& t) const {
+    const Vector3D t1 = (minPoint - ray.origin).multiply(ray.inverseDir);
+    const Vector3D t2 = (maxPoint - ray.origin).multiply(ray.inverseDir);
+
+    const float lowT = greater(greater(smaller(t1.x, t2.x), smaller(t1.y, t2.y)), smaller(t1.z, t2.z));
+    const float highT = smaller(smaller(greater(t1.x, t2.x), greater(t1.y, t2.y)), greater(t1.z, t2.z));
+
+    if (lowT >= highT || lowT >= far) { // If the interval for t is empty or the closer intersection is out of range
+        return false;
+    } else if (lowT > EPSILON6) { // The intersection occurs in the forward direction of the ray
+        t = lowT;
+    } else if (highT <= EPSILON6 || highT >= far) { // The AABB is behind the object or the intersection is out range
+        return false;
+    } else { // Origin of the ray is in the AABB
+        t = highT;
+    }
+    return true;
+}
+
+// Checks whether the ray intersects the AABB and records the hit
+inline bool AABB::intersect(Hit* hit, const Ray& ray, float far) const {
+    float t;
+    if (!findT(invertRay(ray), far, t)) {
+        return false;
+    }
+
+    *hit = Hit{.t = t, .shape = this, .primitiveIndex = 0};
+    return true;
+}
+
+inline bool AABB::occluded(Shape** occludingShape, const Ray& ray, float far) const {
+    float t;
+    if (!findT(invertRay(ray), far, t)) {
+        return false;
+    }
+
+    *occludingShape = (Shape*)this;
+    return true;
+}
+
 #endif // __AABB_H__
@@ -0,0 +1,140 @@
+
+#include "slab.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void setAABB4Lane(AABB4& boxes, uint32_t lane, const Vector3D& minPoint, const Vector3D& maxPoint) {
+    assert(lane < 4);
+    boxes.bounds[0][lane] = minPoint.x;
+    boxes.bounds[1][lane] = minPoint.y;
+    boxes.bounds[2][lane] = minPoint.z;
+    boxes.bounds[3][lane] = maxPoint.x;
+    boxes.bounds[4][lane] = maxPoint.y;
+    boxes.bounds[5][lane] = maxPoint.z;
+}
+
+#ifdef __SSE2__
+
+uint32_t intersectAABB4(const AABB4& boxes, const InverseRay& ray, float far, float* ts) {
+    // The direction signs decide which plane of each axis the ray crosses first, so no min/max is needed per axis
+    const uint32_t nearX = 3 * ray.dirIsNegative[0];
+    const uint32_t nearY = 1 + 3 * ray.dirIsNegative[1];
+    const uint32_t nearZ = 2 + 3 * ray.dirIsNegative[2];
+    const uint32_t farX = 3 - 3 * ray.dirIsNegative[0];
+    const uint32_t farY = 4 - 3 * ray.dirIsNegative[1];
+    const uint32_t farZ = 5 - 3 * ray.dirIsNegative[2];
+
+    const __m128 originX = _mm_set1_ps(ray.origin.x);
+    const __m128 originY = _mm_set1_ps(ray.origin.y);
+    const __m128 originZ = _mm_set1_ps(ray.origin.z);
+    const __m128 inverseDirX = _mm_set1_ps(ray.inverseDir.x);
+    const __m128 inverseDirY = _mm_set1_ps(ray.inverseDir.y);
+    const __m128 inverseDirZ = _mm_set1_ps(ray.inverseDir.z);
+
+    const __m128 nearTX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.bounds[nearX]), originX), inverseDirX);
+    const __m128 nearTY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.bounds[nearY]), originY), inverseDirY);
+    const __m128 nearTZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.bounds[nearZ]), originZ), inverseDirZ);
+    const __m128 farTX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.bounds[farX]), originX), inverseDirX);
+    const __m128 farTY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.bounds[farY]), originY), inverseDirY);
+    const __m128 farTZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.bounds[farZ]), originZ), inverseDirZ);
+
+    const __m128 lowT = _mm_max_ps(_mm_max_ps(nearTX, nearTY), nearTZ);
+    const __m128 highT = _mm_min_ps(_mm_min_ps(_mm_min_ps(farTX, farTY), farTZ), _mm_set1_ps(far));
+
+    // The ray hits a box if the interval is not empty, ends in front of the origin, and starts before far
+    const __m128 hits = _mm_and_ps(
+        _mm_cmple_ps(lowT, highT), 
+        _mm_and_ps(_mm_cmpgt_ps(highT, _mm_setzero_ps()), _mm_cmplt_ps(lowT, _mm_set1_ps(far)))
+    );
+
+    _mm_storeu_ps(ts, lowT);
+    return _mm_movemask_ps(hits);
+}
+
+uint32_t intersectFrustumAABB4(const AABB4& boxes, const Frustum& frustum, float* distances) {
+    const __m128 apexX = _mm_set1_ps(frustum.apex.x);
+    const __m128 apexY = _mm_set1_ps(frustum.apex.y);
+    const __m128 apexZ = _mm_set1_ps(frustum.apex.z);
+
+    // Corners of the boxes relative to the apex
+    const __m128 minX = _mm_sub_ps(_mm_load_ps(boxes.bounds[0]), apexX);
+    const __m128 minY = _mm_sub_ps(_mm_load_ps(boxes.bounds[1]), apexY);
+    const __m128 minZ = _mm_sub_ps(_mm_load_ps(boxes.bounds[2]), apexZ);
+    const __m128 maxX = _mm_sub_ps(_mm_load_ps(boxes.bounds[3]), apexX);
+    const __m128 maxY = _mm_sub_ps(_mm_load_ps(boxes.bounds[4]), apexY);
+    const __m128 maxZ = _mm_sub_ps(_mm_load_ps(boxes.bounds[5]), apexZ);
+
+    // A box is outside if its corner which is the farthest along the normal of a plane is behind that plane
+    __m128 overlaps = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (uint32_t i = 0; i < 4; i++) {
+        const Vector3D& normal = frustum.planeNormals[i];
+        const __m128 distance = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps((normal.x > 0.0f) ? maxX : minX, _mm_set1_ps(normal.x)), 
+            _mm_mul_ps((normal.y > 0.0f) ? maxY : minY, _mm_set1_ps(normal.y))), 
+            _mm_mul_ps((normal.z > 0.0f) ? maxZ : minZ, _mm_set1_ps(normal.z)));
+        overlaps = _mm_and_ps(overlaps, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+    }
+
+    // Distance to the closest point of each box, whose coordinates are zero on the axes where the apex is in the slab
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 closestX = _mm_max_ps(minX, _mm_min_ps(maxX, zero));
+    const __m128 closestY = _mm_max_ps(minY, _mm_min_ps(maxY, zero));
+    const __m128 closestZ = _mm_max_ps(minZ, _mm_min_ps(maxZ, zero));
+    _mm_storeu_ps(distances, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(closestX, closestX), 
+        _mm_mul_ps(closestY, closestY)), 
+        _mm_mul_ps(closestZ, closestZ))));
+
+    return _mm_movemask_ps(overlaps);
+}
+
+#else
+
+uint32_t intersectAABB4(const AABB4& boxes, const InverseRay& ray, float far, float* ts) {
+    const float* origin = &ray.origin.x;
+    const float* inverseDir = &ray.inverseDir.x;
+    uint32_t hitMask = 0;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        float lowT = -INFINITY;
+        float highT = far;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            const uint32_t nearPlane = axis + 3 * ray.dirIsNegative[axis];
+            const uint32_t farPlane = axis + 3 - 3 * ray.dirIsNegative[axis];
+            lowT = greater(lowT, (boxes.bounds[nearPlane][i] - origin[axis]) * inverseDir[axis]);
+            highT = smaller(highT, (boxes.bounds[farPlane][i] - origin[axis]) * inverseDir[axis]);
+        }
+
+        ts[i] = lowT;
+        if (lowT <= highT && highT > 0.0f && lowT < far) {
+            hitMask |= 1 << i;
+        }
+    }
+
+    return hitMask;
+}
+
+uint32_t intersectFrustumAABB4(const AABB4& boxes, const Frustum& frustum, float* distances) {
+    uint32_t overlapMask = 0;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        const Vector3D minPoint = Vector3D(boxes.bounds[0][i], boxes.bounds[1][i], boxes.bounds[2][i]);
+        const Vector3D maxPoint = Vector3D(boxes.bounds[3][i], boxes.bounds[4][i], boxes.bounds[5][i]);
+        if (frustumOverlapsAABB(frustum, minPoint, maxPoint)) {
+            overlapMask |= 1 << i;
+        }
+
+        const Vector3D closestPoint = Vector3D(
+            greater(minPoint.x, smaller(maxPoint.x, frustum.apex.x)),
+            greater(minPoint.y, smaller(maxPoint.y, frustum.apex.y)),
+            greater(minPoint.z, smaller(maxPoint.z, frustum.apex.z))
+        );
+        distances[i] = (closestPoint - frustum.apex).mag();
+    }
+
+    return overlapMask;
+}
+
+#endif // __SSE2__
@@ -0,0 +1,50 @@
+
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdint.h>
+#include <vector3d.h>
+#include <ray_packet.h>
+
+// Direction components smaller than this are clamped before they are inverted, which keeps the slab distances finite
+#define SLAB_MIN_DIR_COMPONENT 1E-20f
+
+// Ray with the reciprocal of its direction and the signs of its direction components for the slab tests
+typedef struct {
+    Vector3D origin;
+    Vector3D inverseDir;
+    uint32_t dirIsNegative[3];
+} InverseRay;
+
+// Bounds of four boxes in structure-of-arrays layout
+// bounds[i] keeps the minimum coordinates along axis i, and bounds[i+3] keeps the maximum ones
+typedef struct alignas(16) {
+    float bounds[6][4];
+} AABB4;
+
+
+void setAABB4Lane(AABB4& boxes, uint32_t lane, const Vector3D& minPoint, const Vector3D& maxPoint);
+
+// Returns a mask whose bit i is set if the ray enters box i before far, and writes the entry distances to ts
+uint32_t intersectAABB4(const AABB4& boxes, const InverseRay& ray, float far, float* ts);
+
+// Returns a mask whose bit i is set unless box i is completely outside the frustum,
+// and writes the distances from the apex of the frustum to the boxes
+uint32_t intersectFrustumAABB4(const AABB4& boxes, const Frustum& frustum, float* distances);
+
+// Defined in the header, so that the primitive tests which invert a single ray can inline it
+inline InverseRay invertRay(const Ray& ray) {
+    const Vector3D clampedDir = Vector3D(
+        (abs(ray.dir.x) < SLAB_MIN_DIR_COMPONENT) ? copysignf(SLAB_MIN_DIR_COMPONENT, ray.dir.x) : ray.dir.x,
+        (abs(ray.dir.y) < SLAB_MIN_DIR_COMPONENT) ? copysignf(SLAB_MIN_DIR_COMPONENT, ray.dir.y) : ray.dir.y,
+        (abs(ray.dir.z) < SLAB_MIN_DIR_COMPONENT) ? copysignf(SLAB_MIN_DIR_COMPONENT, ray.dir.z) : ray.dir.z
+    );
+
+    return InverseRay{
+        .origin = ray.origin,
+        .inverseDir = Vector3D(1.0f / clampedDir.x, 1.0f / clampedDir.y, 1.0f / clampedDir.z),
+        .dirIsNegative = {clampedDir.x < 0.0f, clampedDir.y < 0.0f, clampedDir.z < 0.0f},
+    };
+}
+
+#endif // __SLAB_H__
@@ -1,43 +1,240 @@
 
 #include "bezier.h"
 
-BezierSurface::BezierSurface() : Shape(), subdivision(4) {}
+// Finds the bounds of the 16 control points of a patch, which contain the patch
+static void findControlPointBounds(const Vector3D* points, Vector3D& minPoint, Vector3D& maxPoint) {
+    minPoint = Vector3D(INFINITY);
+    maxPoint = Vector3D(-INFINITY);
 
-BezierSurface::BezierSurface(const Vector3D* controlPoints_, uint32_t subdivision_, const Color& color, 
-    float reflectivity, float transparency, float refractiveIndex) : Shape(color, reflectivity, transparency, refractiveIndex), 
-    subdivision(subdivision_), controlPoints(controlPoints_) {
-        
+    for (uint32_t i = 0; i < 16; i++) {
+        if (points[i].x < minPoint.x) {
+            minPoint.x = points[i].x;
+        } 
+        if (points[i].x > maxPoint.x) {
+            maxPoint.x = points[i].x;
+        }
+
+        if (points[i].y < minPoint.y) {
+            minPoint.y = points[i].y;
+        } 
+        if (points[i].y > maxPoint.y) {
+            maxPoint.y = points[i].y;
+        }
+
+        if (points[i].z < minPoint.z) {
+            minPoint.z = points[i].z;
+        } 
+        if (points[i].z > maxPoint.z) {
+            maxPoint.z = points[i].z;
+        }
+    }
+}
+
+// Splits the cubic curve of the four points which are stride apart at the parameter t with de Casteljau's algorithm
+// The control points of the two parts are written to first and second with the same stride
+static void splitCubicBezier(const Vector3D* points, uint32_t stride, float t, Vector3D* first, Vector3D* second) {
+    const Vector3D p01 = points[0] + (points[stride] - points[0]) * t;
+    const Vector3D p12 = points[stride] + (points[2*stride] - points[stride]) * t;
+    const Vector3D p23 = points[2*stride] + (points[3*stride] - points[2*stride]) * t;
+    const Vector3D p012 = p01 + (p12 - p01) * t;
+    const Vector3D p123 = p12 + (p23 - p12) * t;
+    const Vector3D middle = p012 + (p123 - p012) * t;
+
+    first[0] = points[0];
+    first[stride] = p01;
+    first[2*stride] = p012;
+    first[3*stride] = middle;
+    second[0] = middle;
+    second[stride] = p123;
+    second[2*stride] = p23;
+    second[3*stride] = points[3*stride];
+}
+
+// Builds the node of the subpatch with the given control points, which covers the cells [firstU, endU) x [firstV, endV) of a grid
+// The longer side of the subpatch is split in half until it has at most maxLeafCells cells, so every two levels form a quadtree
+// Each node is bounded by the control points of its subpatch, which contain the subpatch, expanded by expansion
+// addLeaf(firstU, endU, firstV, endV, minPoint, maxPoint) appends the primitives of a leaf and may shrink its bounds to them
+template <typename Function>
+static void buildQuadtree(const Vector3D* points, uint32_t firstU, uint32_t endU, uint32_t firstV, uint32_t endV, 
+    uint32_t maxLeafCells, float expansion, uint32_t nodeIndex, std::vector<BVHNode>& nodes, 
+    std::vector<uint32_t>& primitiveIndices, Function addLeaf) {
     Vector3D minPoint;
     Vector3D maxPoint;
-    findAABBMinMaxPoints(minPoint, maxPoint);
-    boundingVolume.setMinPoint(minPoint);
-    boundingVolume.setMaxPoint(maxPoint);
+    findControlPointBounds(points, minPoint, maxPoint);
+    minPoint -= Vector3D(expansion);
+    maxPoint += Vector3D(expansion);
+
+    const uint32_t cellsU = endU - firstU;
+    const uint32_t cellsV = endV - firstV;
+    if (cellsU * cellsV <= maxLeafCells) {
+        const uint32_t first = primitiveIndices.size();
+        addLeaf(firstU, endU, firstV, endV, minPoint, maxPoint);
+        nodes[nodeIndex] = BVHNode{
+            .minPoint = minPoint, 
+            .maxPoint = maxPoint, 
+            .leftOrFirst = first, 
+            .count = (uint32_t)primitiveIndices.size() - first,
+        };
+        return;
+    }
+
+    // The first index of the control points goes along u, the second one along v
+    const bool splitU = cellsU >= cellsV;
+    const uint32_t cells = splitU ? cellsU : cellsV;
+    const float t = (float)(cells / 2) / cells;
+    Vector3D halves[2][16];
+    for (uint32_t i = 0; i < 4; i++) {
+        if (splitU) {
+            splitCubicBezier(points + i, 4, t, halves[0] + i, halves[1] + i);
+        } else {
+            splitCubicBezier(points + 4*i, 1, t, halves[0] + 4*i, halves[1] + 4*i);
+        }
+    }
+
+    const uint32_t leftIndex = nodes.size();
+    nodes.resize(leftIndex + 2);
+    if (splitU) {
+        const uint32_t middleU = firstU + cellsU / 2;
+        buildQuadtree(halves[0], firstU, middleU, firstV, endV, maxLeafCells, expansion, leftIndex, nodes, primitiveIndices, addLeaf);
+        buildQuadtree(halves[1], middleU, endU, firstV, endV, maxLeafCells, expansion, leftIndex+1, nodes, primitiveIndices, addLeaf);
+    } else {
+        const uint32_t middleV = firstV + cellsV / 2;
+        buildQuadtree(halves[0], firstU, endU, firstV, middleV, maxLeafCells, expansion, leftIndex, nodes, primitiveIndices, addLeaf);
+        buildQuadtree(halves[1], firstU, endU, middleV, endV, maxLeafCells, expansion, leftIndex+1, nodes, primitiveIndices, addLeaf);
+    }
+
+    // The children may be bounded tighter than the control points of the subpatch
+    const BVHNode& left = nodes[leftIndex];
+    const BVHNode& right = nodes[leftIndex+1];
+    nodes[nodeIndex] = BVHNode{
+        .minPoint = Vector3D(
+            greater(minPoint.x, smaller(left.minPoint.x, right.minPoint.x)), 
+            greater(minPoint.y, smaller(left.minPoint.y, right.minPoint.y)), 
+            greater(minPoint.z, smaller(left.minPoint.z, right.minPoint.z))
+        ), 
+        .maxPoint = Vector3D(
+            smaller(maxPoint.x, greater(left.maxPoint.x, right.maxPoint.x)), 
+            smaller(maxPoint.y, greater(left.maxPoint.y, right.maxPoint.y)), 
+            smaller(maxPoint.z, greater(left.maxPoint.z, right.maxPoint.z))
+        ), 
+        .leftOrFirst = leftIndex, 
+        .count = 0,
+    };
+}
+
+BezierSurface::BezierSurface() : Shape(), subdivision(4) {}
 
-    Vector3D vertices[(subdivision+1) * (subdivision+1)];
+BezierSurface::BezierSurface(const Vector3D* controlPoints_, uint32_t subdivision_, const Color& color, 
+    float reflectivity, float transparency, float refractiveIndex, float quantizationStep_) 
+    : Shape(color, reflectivity, transparency, refractiveIndex), subdivision(subdivision_), controlPoints(controlPoints_), 
+    quantizationStep(quantizationStep_) {
+
+    assert(0 < subdivision && subdivision <= BEZIER_MAX_SUBDIVISION);
     const float dx = 1.0f / subdivision;
-    uint32_t index = 0;
 
     // Sample the vertices of (subdivision X subdivision) many surfaces
-    for (float u = 0; u <= 1.0f; u += dx) {
-        for (float v = 0; v <= 1.0f; v += dx) {
-            vertices[index++] = getPoint(u, v); 
+    vertices.reserve((subdivision+1) * (subdivision+1));
+    for (uint32_t i = 0; i <= subdivision; i++) {
+        for (uint32_t j = 0; j <= subdivision; j++) {
+            vertices.push_back(getPoint(i * dx, j * dx)); 
         }
     }
 
-    // Triangulate the surfaces
-    index = 0;
+    // The triangles are built from the quantized vertices, so the hierarchy bounds what the kernels intersect
+    if (quantizationStep > 0.0f) {
+        quantizeVertices();
+    }
+
+    // Triangulate the surfaces, each one is split into two triangles which share the vertices of the grid
+    indices.reserve(6 * subdivision * subdivision);
+    uint32_t index = 0;
     for (uint32_t i = 0; i < subdivision; i++) {
         for (uint32_t j = 0; j < subdivision; j++) {
-            const Vector3D vertex1 = vertices[index+j];
-            const Vector3D vertex2 = vertices[index+j+1];
-            const Vector3D vertex3 = vertices[index+subdivision+j+1];
-            const Vector3D vertex4 = vertices[index+subdivision+j+2];
+            const uint16_t vertex1 = index+j;
+            const uint16_t vertex2 = index+j+1;
+            const uint16_t vertex3 = index+subdivision+j+1;
+            const uint16_t vertex4 = index+subdivision+j+2;
 
-            triangles.push_back(Triangle(vertex3, vertex2, vertex1, color, reflectivity, transparency, refractiveIndex));
-            triangles.push_back(Triangle(vertex3, vertex4, vertex2, color, reflectivity, transparency, refractiveIndex));
+            indices.insert(indices.end(), {vertex3, vertex2, vertex1});
+            indices.insert(indices.end(), {vertex3, vertex4, vertex2});
         }
         index += subdivision+1;
     }
+
+    // Build the quadtree of the subpatches down to the leaves of up to TRIANGLE_BLOCK_SIZE triangles
+    // The bounds of a leaf shrink to its triangles, which are inside the control points of its subpatch unless they are snapped
+    std::vector<BVHNode> nodes(1);
+    std::vector<uint32_t> primitiveIndices;
+    buildQuadtree(controlPoints, 0, subdivision, 0, subdivision, TRIANGLE_BLOCK_SIZE / 2, EPSILON3 + quantizationStep, 0, 
+        nodes, primitiveIndices, [&](uint32_t firstU, uint32_t endU, uint32_t firstV, uint32_t endV, Vector3D& minPoint, Vector3D& maxPoint) {
+            Vector3D triangleMinPoint = Vector3D(INFINITY);
+            Vector3D triangleMaxPoint = Vector3D(-INFINITY);
+            for (uint32_t i = firstU; i < endU; i++) {
+                for (uint32_t j = firstV; j < endV; j++) {
+                    // The cell (i, j) of the grid is split into the triangles 2 * (i*subdivision + j) and the next one
+                    for (uint32_t k = 0; k < 2; k++) {
+                        const uint32_t triangleIndex = 2 * (i*subdivision + j) + k;
+                        Vector3D a, b, c;
+                        getTriangleVertices(triangleIndex, a, b, c);
+                        triangleMinPoint = Vector3D(
+                            smaller(smaller(smaller(a.x, b.x), c.x), triangleMinPoint.x), 
+                            smaller(smaller(smaller(a.y, b.y), c.y), triangleMinPoint.y), 
+                            smaller(smaller(smaller(a.z, b.z), c.z), triangleMinPoint.z)
+                        );
+                        triangleMaxPoint = Vector3D(
+                            greater(greater(greater(a.x, b.x), c.x), triangleMaxPoint.x), 
+                            greater(greater(greater(a.y, b.y), c.y), triangleMaxPoint.y), 
+                            greater(greater(greater(a.z, b.z), c.z), triangleMaxPoint.z)
+                        );
+                        primitiveIndices.push_back(triangleIndex);
+                    }
+                }
+            }
+
+            minPoint = Vector3D(greater(minPoint.x, triangleMinPoint.x), greater(minPoint.y, triangleMinPoint.y), 
+                greater(minPoint.z, triangleMinPoint.z));
+            maxPoint = Vector3D(smaller(maxPoint.x, triangleMaxPoint.x), smaller(maxPoint.y, triangleMaxPoint.y), 
+                smaller(maxPoint.z, triangleMaxPoint.z));
+        });
+    triangleBVH = BVH(nodes, primitiveIndices, TRIANGLE_BLOCK_SIZE);
+
+    // Store the triangles in the order of the leaves, so that the indices of a block are contiguous
+    // The padding lanes of the last block are degenerate triangles on the first vertex
+    const std::vector<uint32_t>& triangleIndices = triangleBVH.getPrimitiveIndices();
+    std::vector<uint16_t> leafIndices(3 * triangleIndices.size(), 0);
+    for (uint32_t i = 0; i < triangleIndices.size(); i++) {
+        if (triangleIndices[i] != BVH_INVALID_INDEX) {
+            for (uint32_t j = 0; j < 3; j++) {
+                leafIndices[3*i+j] = indices[3*triangleIndices[i]+j];
+            }
+        }
+    }
+    indices = leafIndices;
+
+    if (quantizationStep > 0.0f) {
+        // The vertices are decoded from their quantized coordinates from now on
+        vertices.clear();
+        vertices.shrink_to_fit();
+    }
+}
+
+BezierSurface::BezierSurface(const Vector3D* controlPoints_, const Color& color, float reflectivity, float transparency, 
+    float refractiveIndex) : Shape(color, reflectivity, transparency, refractiveIndex), subdivision(0), controlPoints(controlPoints_) {
+
+    // The leaves of the quadtree are the single cells of a grid of 2^depth x 2^depth subpatches
+    const uint32_t cellCount = 1 << BEZIER_EXACT_SUBDIVISION_DEPTH;
+    std::vector<BVHNode> nodes(1);
+    std::vector<uint32_t> primitiveIndices;
+    buildQuadtree(controlPoints, 0, cellCount, 0, cellCount, 1, EPSILON3, 0, nodes, primitiveIndices, 
+        [&](uint32_t firstU, uint32_t, uint32_t firstV, uint32_t, Vector3D&, Vector3D&) {
+            primitiveIndices.push_back(subpatches.size());
+            subpatches.push_back(BezierSubpatch{
+                .minU = (float)firstU / cellCount, 
+                .minV = (float)firstV / cellCount, 
+                .size = 1.0f / cellCount,
+            });
+        });
+    subpatchBVH = BVH(nodes, primitiveIndices);
 }
 
 // Calculates B(u) and B(v) for surface function
@@ -69,65 +266,350 @@ Vector3D BezierSurface::getPoint(float u, float v) const {
     return point;
 }
 
-// Checks whether the ray intersects the surface and finds the intersection details
-bool BezierSurface::intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const {
-    if (!boundingVolume.intersect(NULL, NULL, ray, far)) {
-        return false;
+// Calculates the surface point and its partial derivatives along u and v
+void BezierSurface::evaluate(float u, float v, Vector3D& point, Vector3D& uTangent, Vector3D& vTangent) const {
+    float uVector[4];
+    float vVector[4];
+    generateControlPointScalars(uVector, u);
+    generateControlPointScalars(vVector, v);
+
+    // Derivatives of the cubic Bernstein polynomials
+    const float uDerivatives[4] = {-3.0f*(1.0f-u)*(1.0f-u), 3.0f*(1.0f-u)*(1.0f-3.0f*u), 3.0f*u*(2.0f-3.0f*u), 3.0f*u*u};
+    const float vDerivatives[4] = {-3.0f*(1.0f-v)*(1.0f-v), 3.0f*(1.0f-v)*(1.0f-3.0f*v), 3.0f*v*(2.0f-3.0f*v), 3.0f*v*v};
+
+    point = Vector3D(0.0f);
+    uTangent = Vector3D(0.0f);
+    vTangent = Vector3D(0.0f);
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        for (uint32_t j = 0; j < 4; j++) {
+            point += controlPoints[index] * (uVector[i] * vVector[j]);
+            uTangent += controlPoints[index] * (uDerivatives[i] * vVector[j]);
+            vTangent += controlPoints[index] * (uVector[i] * vDerivatives[j]);
+            index++;
+        }
     }
+}
+
+// Finds the closest intersection of an exact surface in (0, far), or any of them if anyHit is set
+// The ray is the intersection of two planes which contain it, so a surface point (u, v) is on the ray if its distances to both
+// planes are zero. Newton's method solves these two equations from the center of every subpatch that the ray enters.
+// The iteration is kept in the parameter range of the subpatch, so each subpatch reports only its own roots and
+// the closest root does not depend on the order in which the subpatches are visited.
+bool BezierSurface::findExactT(const Ray& ray, float far, bool anyHit, float& t, float& u, float& v) const {
+    const Vector3D axis = (abs(ray.dir.x) > abs(ray.dir.y)) ? Vector3D::up : Vector3D::right;
+    const Vector3D planeNormal1 = ray.dir.cross(axis).normalize();
+    const Vector3D planeNormal2 = ray.dir.cross(planeNormal1);
+    const float planeDistance1 = -planeNormal1.dot(ray.origin);
+    const float planeDistance2 = -planeNormal2.dot(ray.origin);
 
-    if (intersect == NULL) {
-        for (uint32_t i = 0; i < triangles.size(); i++) {
-            if (triangles[i].intersect(NULL, intersectedShape, ray, far)) {
-                return true;
+    bool hitFound = false;
+    const auto intersectSubpatch = [&](uint32_t index, float& far) {
+        const BezierSubpatch& subpatch = subpatches[index];
+        float subpatchU = subpatch.minU + 0.5f * subpatch.size;
+        float subpatchV = subpatch.minV + 0.5f * subpatch.size;
+        const float minU = greater(subpatch.minU - BEZIER_SUBPATCH_MARGIN, 0.0f);
+        const float minV = greater(subpatch.minV - BEZIER_SUBPATCH_MARGIN, 0.0f);
+        const float maxU = smaller(subpatch.minU + subpatch.size + BEZIER_SUBPATCH_MARGIN, 1.0f);
+        const float maxV = smaller(subpatch.minV + subpatch.size + BEZIER_SUBPATCH_MARGIN, 1.0f);
+
+        for (uint32_t i = 0; i < BEZIER_NEWTON_MAX_ITERATIONS; i++) {
+            Vector3D point;
+            Vector3D uTangent;
+            Vector3D vTangent;
+            evaluate(subpatchU, subpatchV, point, uTangent, vTangent);
+
+            const float distance1 = planeNormal1.dot(point) + planeDistance1;
+            const float distance2 = planeNormal2.dot(point) + planeDistance2;
+            if (abs(distance1) < BEZIER_NEWTON_TOLERANCE && abs(distance2) < BEZIER_NEWTON_TOLERANCE) {
+                const float pointT = (point - ray.origin).dot(ray.dir);
+                if (pointT <= EPSILON4 || pointT >= far) {
+                    return false;
+                }
+
+                t = pointT;
+                u = subpatchU;
+                v = subpatchV;
+                far = pointT;
+                hitFound = true;
+                return anyHit;
+            }
+
+            // Solve the Jacobian system for the step, and keep the parameters on the subpatch
+            const float jacobian11 = planeNormal1.dot(uTangent);
+            const float jacobian12 = planeNormal1.dot(vTangent);
+            const float jacobian21 = planeNormal2.dot(uTangent);
+            const float jacobian22 = planeNormal2.dot(vTangent);
+            const float determinant = jacobian11*jacobian22 - jacobian12*jacobian21;
+            if (determinant == 0.0f) {
+                return false;
             }
+
+            const float inverseDeterminant = 1.0f / determinant;
+            subpatchU -= (jacobian22*distance1 - jacobian12*distance2) * inverseDeterminant;
+            subpatchV -= (jacobian11*distance2 - jacobian21*distance1) * inverseDeterminant;
+            subpatchU = greater(smaller(subpatchU, maxU), minU);
+            subpatchV = greater(smaller(subpatchV, maxV), minV);
         }
+        return false;
+    };
+
+    if (anyHit) {
+        subpatchBVH.traverse<false>(ray, far, intersectSubpatch);
     } else {
-        Intersect closestIntersect = {.t = INFINITY};
-        Intersect currentIntersect;
-        Shape* closestShape = NULL;
-        Shape* currentShape;
-
-        for (uint32_t i = 0; i < triangles.size(); i++) {
-            if (triangles[i].intersect(&currentIntersect, &currentShape, ray, far) && currentIntersect.t < closestIntersect.t) {
-                closestIntersect = currentIntersect;
-                closestShape = currentShape;
-            }
+        subpatchBVH.traverse(ray, far, intersectSubpatch);
+    }
+    return hitFound;
+}
+
+// Checks whether the ray intersects the surface and finds the intersection details
+bool BezierSurface::intersect(Hit* hit, const Ray& ray, float far) const {
+    assert(hit != NULL);
+
+    // The parameters of an exact hit are kept in place of the barycentric coordinates
+    if (isExact()) {
+        float t;
+        float u;
+        float v;
+        if (!findExactT(ray, far, false, t, u, v)) {
+            return false;
         }
-        
-        if (closestShape != NULL) {
-            *intersect = closestIntersect;
-            *intersectedShape = closestShape;
-            return true;
-        } 
+
+        *hit = Hit{.t = t, .shape = this, .primitiveIndex = 0, .beta = u, .gamma = v};
+        return true;
     }
 
-    return false;
+    bool hitFound = false;
+
+    // Every hit is closer than the previous ones since the range shrinks after each hit
+    triangleBVH.traverseLeaves(ray, far, [&](uint32_t first, uint32_t, float& far) {
+        TriangleBlock block;
+        float t;
+        float beta;
+        float gamma;
+        getTriangleBlock(first / TRIANGLE_BLOCK_SIZE, block);
+        const int32_t lane = intersectTriangleBlock(block, ray, far, t, beta, gamma);
+        if (lane >= 0) {
+            *hit = Hit{.t = t, .shape = this, .primitiveIndex = first + lane, .beta = beta, .gamma = gamma};
+            hitFound = true;
+            far = t;
+        }
+        return false;
+    });
+
+    return hitFound;
 }
 
-void BezierSurface::findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const {
-    minPoint = Vector3D(INFINITY);
-    maxPoint = Vector3D(-INFINITY);
+float BezierSurface::findQuantizationStep(const Vector3D* points, uint32_t count) {
+    assert(count > 0);
+    Vector3D minPoint = points[0];
+    Vector3D maxPoint = points[0];
+    for (uint32_t i = 1; i < count; i++) {
+        minPoint = Vector3D(smaller(minPoint.x, points[i].x), smaller(minPoint.y, points[i].y), smaller(minPoint.z, points[i].z));
+        maxPoint = Vector3D(greater(maxPoint.x, points[i].x), greater(maxPoint.y, points[i].y), greater(maxPoint.z, points[i].z));
+    }
 
-    for (uint32_t i = 0; i < 16; i++) {
-        if (controlPoints[i].x < minPoint.x) {
-            minPoint.x = controlPoints[i].x;
-        } 
-        if (controlPoints[i].x > maxPoint.x) {
-            maxPoint.x = controlPoints[i].x;
+    // A power of two step keeps the grid origins and the decoded vertices exact in floating point
+    const Vector3D extent = maxPoint - minPoint;
+    const float maxExtent = greater(greater(extent.x, extent.y), extent.z);
+    int exponent;
+    frexpf(maxExtent / BEZIER_MAX_QUANTIZED_COORDINATE, &exponent);
+    return ldexpf(1.0f, exponent);
+}
+
+// Snaps the vertices to the grid of the quantization step, whose origin is a multiple of the step
+// The sampled vertices are replaced by the snapped ones, which the triangles are built from
+void BezierSurface::quantizeVertices(void) {
+    Vector3D minPoint;
+    Vector3D maxPoint;
+    findAABBMinMaxPoints(minPoint, maxPoint);
+    quantizationOrigin = Vector3D(
+        floorf(minPoint.x / quantizationStep) * quantizationStep, 
+        floorf(minPoint.y / quantizationStep) * quantizationStep, 
+        floorf(minPoint.z / quantizationStep) * quantizationStep
+    );
+
+    const auto quantize = [&](float value, float origin) {
+        const float coordinate = roundf((value - origin) / quantizationStep);
+        assert(0.0f <= coordinate && coordinate <= UINT16_MAX);
+        return (uint16_t)coordinate;
+    };
+
+    quantizedVertices.resize(3 * vertices.size());
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+        quantizedVertices[3*i] = quantize(vertices[i].x, quantizationOrigin.x);
+        quantizedVertices[3*i+1] = quantize(vertices[i].y, quantizationOrigin.y);
+        quantizedVertices[3*i+2] = quantize(vertices[i].z, quantizationOrigin.z);
+
+        const Vector3D quantizedVertex = getVertex(i);
+        maxQuantizationError = greater(maxQuantizationError, (quantizedVertex - vertices[i]).mag());
+        vertices[i] = quantizedVertex;
+    }
+}
+
+// Decodes the vertex in the compressed mode with the same arithmetic as gatherQuantizedTriangleBlock
+Vector3D BezierSurface::getVertex(uint32_t index) const {
+    if (quantizedVertices.empty()) {
+        assert(index < vertices.size());
+        return vertices[index];
+    }
+
+    assert(3*index + 2 < quantizedVertices.size());
+    return Vector3D(
+        quantizationOrigin.x + quantizationStep * quantizedVertices[3*index], 
+        quantizationOrigin.y + quantizationStep * quantizedVertices[3*index+1], 
+        quantizationOrigin.z + quantizationStep * quantizedVertices[3*index+2]
+    );
+}
+
+void BezierSurface::getTriangleVertices(uint32_t triangleIndex, Vector3D& a, Vector3D& b, Vector3D& c) const {
+    assert(3*triangleIndex + 2 < indices.size());
+    a = getVertex(indices[3*triangleIndex]);
+    b = getVertex(indices[3*triangleIndex+1]);
+    c = getVertex(indices[3*triangleIndex+2]);
+}
+
+void BezierSurface::getTriangleBlock(uint32_t blockIndex, TriangleBlock& block) const {
+    const uint16_t* blockIndices = indices.data() + 3 * TRIANGLE_BLOCK_SIZE * blockIndex;
+    if (quantizedVertices.empty()) {
+        gatherTriangleBlock(vertices.data(), blockIndices, block);
+    } else {
+        gatherQuantizedTriangleBlock(quantizedVertices.data(), quantizationOrigin, quantizationStep, blockIndices, block);
+    }
+}
+
+bool BezierSurface::isExact(void) const {
+    return subdivision == 0;
+}
+
+uint32_t BezierSurface::getTriangleCount(void) const {
+    return 2 * subdivision * subdivision;
+}
+
+uint32_t BezierSurface::getGeometryByteCount(void) const {
+    return vertices.size() * sizeof(Vector3D) + indices.size() * sizeof(uint16_t) + quantizedVertices.size() * sizeof(uint16_t) + 
+        subpatches.size() * sizeof(BezierSubpatch);
+}
+
+float BezierSurface::getMaxQuantizationError(void) const {
+    return maxQuantizationError;
+}
+
+// The normal of the hit triangle is computed from its shared vertices, exact hits get the normal of the surface
+Intersect BezierSurface::getIntersect(const Hit& hit, const Ray& ray) const {
+    Intersect intersect;
+    intersect.t = hit.t;
+    intersect.hitLocation = ray.origin + ray.dir * hit.t;
+
+    if (isExact()) {
+        // A tangent vanishes on the collapsed edges of a patch, so the normal is taken slightly inside the patch there
+        float u = hit.beta;
+        float v = hit.gamma;
+        Vector3D point;
+        Vector3D uTangent;
+        Vector3D vTangent;
+        evaluate(u, v, point, uTangent, vTangent);
+        while (uTangent.cross(vTangent).magSquare() < EPSILON6 && abs(u - 0.5f) + abs(v - 0.5f) > EPSILON3) {
+            u += (0.5f - u) * EPSILON2;
+            v += (0.5f - v) * EPSILON2;
+            evaluate(u, v, point, uTangent, vTangent);
         }
+        intersect.normal = uTangent.cross(vTangent).normalize();
+    } else {
+        Vector3D a, b, c;
+        getTriangleVertices(hit.primitiveIndex, a, b, c);
+        intersect.normal = (b - a).cross(c - a).normalize();
+    }
 
-        if (controlPoints[i].y < minPoint.y) {
-            minPoint.y = controlPoints[i].y;
-        } 
-        if (controlPoints[i].y > maxPoint.y) {
-            maxPoint.y = controlPoints[i].y;
+    if (ray.dir.dot(intersect.normal) > 0.0f) {
+        intersect.normal *= -1.0f;
+    }
+    return intersect;
+}
+
+// Tests each triangle of the leaves that the frustum overlaps against the rows of the packet
+// Exact surfaces test the rays one by one
+void BezierSurface::intersectPacket(Hit* hits, float* fars, const RayPacket& packet) const {
+    if (isExact()) {
+        intersectPacketRays(*this, hits, fars, packet);
+        return;
+    }
+
+    const std::vector<uint32_t>& triangleIndices = triangleBVH.getPrimitiveIndices();
+
+    triangleBVH.traversePacketLeaves(packet, fars, [&](uint32_t first, uint32_t count) {
+        // A leaf is a single block, so it is gathered once for all rays of the packet
+        TriangleBlock block;
+        getTriangleBlock(first / TRIANGLE_BLOCK_SIZE, block);
+
+        for (uint32_t i = first; i < first + count; i++) {
+            if (triangleIndices[i] == BVH_INVALID_INDEX) { // Padding of the last block
+                continue;
+            }
+
+            const uint32_t lane = i % TRIANGLE_BLOCK_SIZE;
+            for (uint32_t j = 0; j < RAY_PACKET_HEIGHT; j++) {
+                const uint32_t firstRay = j * RAY_BLOCK_SIZE;
+                float betas[RAY_BLOCK_SIZE];
+                float gammas[RAY_BLOCK_SIZE];
+                uint32_t hitMask = intersectRayBlock(packet.blocks[j], block, lane, fars + firstRay, betas, gammas);
+
+                while (hitMask != 0) {
+                    const uint32_t ray = __builtin_ctz(hitMask);
+                    hitMask &= hitMask - 1;
+                    hits[firstRay + ray] = Hit{
+                        .t = fars[firstRay + ray], 
+                        .shape = this, 
+                        .primitiveIndex = i, 
+                        .beta = betas[ray], 
+                        .gamma = gammas[ray],
+                    };
+                }
+            }
         }
+    });
+}
 
-        if (controlPoints[i].z < minPoint.z) {
-            minPoint.z = controlPoints[i].z;
-        } 
-        if (controlPoints[i].z > maxPoint.z) {
-            maxPoint.z = controlPoints[i].z;
+// Stops at the first triangle block that the ray hits, the leaves are visited in any order
+// The triangles share the material of the surface, so the surface is the occluding shape
+bool BezierSurface::occluded(Shape** occludingShape, const Ray& ray, float far) const {
+    bool hit = false;
+    if (isExact()) {
+        float t;
+        float u;
+        float v;
+        hit = findExactT(ray, far, true, t, u, v);
+        if (hit) {
+            *occludingShape = (Shape*)this;
         }
+        return hit;
+    }
+
+    triangleBVH.traverseLeaves<false>(ray, far, [&](uint32_t first, uint32_t, float& far) {
+        TriangleBlock block;
+        float t;
+        float beta;
+        float gamma;
+        getTriangleBlock(first / TRIANGLE_BLOCK_SIZE, block);
+        const int32_t lane = intersectTriangleBlock(block, ray, far, t, beta, gamma);
+        hit = lane >= 0;
+        return hit;
+    });
+
+    if (!hit) {
+        return false;
+    }
+
+    *occludingShape = (Shape*)this;
+    return true;
+}
+
+void BezierSurface::findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const {
+    findControlPointBounds(controlPoints, minPoint, maxPoint);
+
+    // Snapping may move the vertices by half a step out of the control points
+    if (quantizationStep > 0.0f) {
+        minPoint -= Vector3D(quantizationStep);
+        maxPoint += Vector3D(quantizationStep);
     }
 }
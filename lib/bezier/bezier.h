@@ -4,23 +4,80 @@
 
 #include <vector>
 #include <triangle.h>
-#include <aabb.h>
+#include <triangle_block.h>
+#include <bvh.h>
 
-class BezierSurface : public Shape {
+// Vertex indices are stored in 16 bits, so the sampled grid can have at most 256x256 vertices
+#define BEZIER_MAX_SUBDIVISION 255
+
+// Largest quantized coordinate that the vertices of a model are fitted in, 
+// it leaves room for the expansion of the bounds of a surface by a step and for the rounding of its grid origin
+#define BEZIER_MAX_QUANTIZED_COORDINATE (UINT16_MAX - 3)
+
+// Exact surfaces are split into 4^depth subpatches, and the center of each subpatch that a ray enters seeds a Newton iteration
+#define BEZIER_EXACT_SUBDIVISION_DEPTH 3
+#define BEZIER_NEWTON_MAX_ITERATIONS   10
+#define BEZIER_NEWTON_TOLERANCE        EPSILON4 // Largest distance between the ray and an accepted surface point
+#define BEZIER_SUBPATCH_MARGIN         EPSILON3 // Parameter overlap of neighbouring subpatches, so no root on their common edge is lost
+
+// Parameter range [minU, minU + size] x [minV, minV + size] of a subpatch of an exact surface
+typedef struct {
+    float minU;
+    float minV;
+    float size;
+} BezierSubpatch;
+
+class BezierSurface final : public Shape {
 private:
     const Vector3D* controlPoints;
-    const uint32_t subdivision;
-    std::vector<Triangle> triangles;
-    AABB boundingVolume;    
+    const uint32_t subdivision; // 0 for the exact surfaces, which are intersected without tessellation
+    std::vector<Vector3D> vertices; // Sampled grid of (subdivision+1)^2 points which are shared by the triangles
+    std::vector<uint16_t> indices;  // Three vertex indices per triangle in the order of the leaves, each leaf is one block
+    BVH triangleBVH;
+
+    // Compressed geometry, which replaces the vertices if the quantization step is positive
+    // A vertex is quantizationOrigin + quantizationStep * its quantized coordinates
+    float quantizationStep = 0.0f;
+    Vector3D quantizationOrigin;
+    std::vector<uint16_t> quantizedVertices; // Three coordinates per vertex
+    float maxQuantizationError = 0.0f;
+
+    // Subpatches of an exact surface and the hierarchy over their control point bounds
+    std::vector<BezierSubpatch> subpatches;
+    BVH subpatchBVH;
 
     void generateControlPointScalars(float* xVector, float x) const;
     Vector3D getPoint(float u, float v) const;
+    void evaluate(float u, float v, Vector3D& point, Vector3D& uTangent, Vector3D& vTangent) const;
+    bool findExactT(const Ray& ray, float far, bool anyHit, float& t, float& u, float& v) const;
+    void quantizeVertices(void);
+    Vector3D getVertex(uint32_t index) const;
+    void getTriangleVertices(uint32_t triangleIndex, Vector3D& a, Vector3D& b, Vector3D& c) const;
+
+    // Gathers the block of a leaf from the shared vertices, or decodes it in the compressed mode
+    void getTriangleBlock(uint32_t blockIndex, TriangleBlock& block) const;
 
 public:
     BezierSurface();
-    BezierSurface(const Vector3D* controlPoints_, uint32_t subdivision_, const Color& color, float reflectivity, float transparency, float refractiveIndex);
+    BezierSurface(const Vector3D* controlPoints_, uint32_t subdivision_, const Color& color, float reflectivity, float transparency, 
+        float refractiveIndex, float quantizationStep_ = 0.0f);
+
+    // Exact surface, whose hits are found on the control points by Newton iterations and get the true surface normals
+    BezierSurface(const Vector3D* controlPoints_, const Color& color, float reflectivity, float transparency, float refractiveIndex);
+
+    // Returns the smallest power of two which quantizes the given points of a model to 16 bits
+    // Surfaces which share this step snap the vertices on their common edges to the same points, so no cracks open between them
+    static float findQuantizationStep(const Vector3D* points, uint32_t count);
+
+    bool isExact(void) const;
+    uint32_t getTriangleCount(void) const;
+    uint32_t getGeometryByteCount(void) const; // Memory of the vertices, the indices and the subpatches
+    float getMaxQuantizationError(void) const; // Largest distance between a sampled vertex and its quantized position
 
-    bool intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const override;
+    bool intersect(Hit* hit, const Ray& ray, float far) const override;
+    Intersect getIntersect(const Hit& hit, const Ray& ray) const override;
+    void intersectPacket(Hit* hits, float* fars, const RayPacket& packet) const override;
+    bool occluded(Shape** occludingShape, const Ray& ray, float far) const override;
     void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const override;
 };
 
@@ -0,0 +1,393 @@
+
+#include "bvh.h"
+#include <algorithm>
+#include <stdexcept>
+
+BVH::BVH() {}
+
+BVH::BVH(const std::vector<Vector3D>& minPoints, const std::vector<Vector3D>& maxPoints, uint32_t threadCount, uint32_t leafBlockSize_)
+    : leafBlockSize(leafBlockSize_), maxLeafSize((leafBlockSize_ > 1) ? leafBlockSize_ : BVH_MAX_LEAF_SIZE) {
+    assert(minPoints.size() == maxPoints.size());
+    assert(threadCount > 0 && leafBlockSize_ > 0);
+    const uint32_t primitiveCount = minPoints.size();
+    if (primitiveCount == 0) {
+        return;
+    }
+
+    std::vector<Vector3D> centroids(primitiveCount);
+    primitiveIndices.resize(primitiveCount);
+    for (uint32_t i = 0; i < primitiveCount; i++) {
+        centroids[i] = (minPoints[i] + maxPoints[i]) * 0.5f;
+        primitiveIndices[i] = i;
+    }
+
+    // A binary tree with n leaves has at most 2n-1 nodes
+    nodes.reserve(2 * primitiveCount - 1);
+    nodes.push_back(BVHNode{.leftOrFirst = 0, .count = primitiveCount});
+    updateNodeBounds(nodes[0], minPoints, maxPoints);
+    subdivide(nodes, 0, minPoints, maxPoints, centroids, threadCount, 1);
+    finishConstruction();
+}
+
+BVH::BVH(const std::vector<BVHNode>& nodes_, const std::vector<uint32_t>& primitiveIndices_, uint32_t leafBlockSize_)
+    : nodes(nodes_), primitiveIndices(primitiveIndices_), leafBlockSize(leafBlockSize_), 
+    maxLeafSize((leafBlockSize_ > 1) ? leafBlockSize_ : BVH_MAX_LEAF_SIZE) {
+    assert(leafBlockSize_ > 0);
+    if (nodes.empty()) {
+        return;
+    }
+    if (findHeight(0) > BVH_MAX_DEPTH) {
+        throw std::invalid_argument("The BVH is deeper than its traversal stack allows");
+    }
+    finishConstruction();
+}
+
+// Aligns the leaves to the blocks and collapses the binary tree into the wide one
+void BVH::finishConstruction(void) {
+    if (leafBlockSize > 1) {
+        alignLeaves();
+    }
+
+    minPoint = nodes[0].minPoint;
+    maxPoint = nodes[0].maxPoint;
+    sahCost = calculateSAHCost();
+
+    // The root of the wide tree gets a single child if the whole tree is a leaf
+    if (nodes[0].count > 0) {
+        wideNodes.push_back(BVHWideNode{.childCount = 1});
+        setAABB4Lane(wideNodes[0].childBounds, 0, nodes[0].minPoint, nodes[0].maxPoint);
+        wideNodes[0].children[0] = nodes[0].leftOrFirst;
+        wideNodes[0].counts[0] = nodes[0].count;
+    } else {
+        wideNodes.reserve(nodes.size() / 2);
+        collapse(0);
+    }
+
+    // The binary nodes are not needed after the collapse
+    nodes = std::vector<BVHNode>();
+}
+
+uint32_t BVH::getNodeCount(void) const {
+    return wideNodes.size();
+}
+
+// Returns the primitive indices in the order of the leaves, the padding of aligned leaves is BVH_INVALID_INDEX
+const std::vector<uint32_t>& BVH::getPrimitiveIndices(void) const {
+    return primitiveIndices;
+}
+
+// Expected cost of tracing a ray which hits the root, relative to a single primitive intersection
+float BVH::getSAHCost(void) const {
+    return sahCost;
+}
+
+// Calculates the SAH cost of the binary tree
+float BVH::calculateSAHCost(void) const {
+    if (nodes.empty()) {
+        return 0.0f;
+    }
+
+    const float rootArea = surfaceArea(nodes[0].minPoint, nodes[0].maxPoint);
+    float cost = 0.0f;
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        const float areaRatio = surfaceArea(nodes[i].minPoint, nodes[i].maxPoint) / rootArea;
+        cost += areaRatio * ((nodes[i].count > 0) ? blockCount(nodes[i].count) * BVH_INTERSECTION_COST : BVH_TRAVERSAL_COST);
+    }
+    return cost;
+}
+
+void BVH::findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const {
+    minPoint = BVH::minPoint;
+    maxPoint = BVH::maxPoint;
+}
+
+// Number of leaf blocks that the given number of primitives occupies
+uint32_t BVH::blockCount(uint32_t count) const {
+    return (count + leafBlockSize - 1) / leafBlockSize;
+}
+
+float BVH::surfaceArea(const Vector3D& minPoint, const Vector3D& maxPoint) {
+    const Vector3D extent = maxPoint - minPoint;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Fits the bounds of the node to the primitives that it contains
+void BVH::updateNodeBounds(BVHNode& node, const std::vector<Vector3D>& minPoints, const std::vector<Vector3D>& maxPoints) const {
+    node.minPoint = Vector3D(INFINITY);
+    node.maxPoint = Vector3D(-INFINITY);
+
+    for (uint32_t i = 0; i < node.count; i++) {
+        const uint32_t primitiveIndex = primitiveIndices[node.leftOrFirst + i];
+        const Vector3D& minPoint = minPoints[primitiveIndex];
+        const Vector3D& maxPoint = maxPoints[primitiveIndex];
+
+        node.minPoint = Vector3D(smaller(node.minPoint.x, minPoint.x), smaller(node.minPoint.y, minPoint.y), smaller(node.minPoint.z, minPoint.z));
+        node.maxPoint = Vector3D(greater(node.maxPoint.x, maxPoint.x), greater(node.maxPoint.y, maxPoint.y), greater(node.maxPoint.z, maxPoint.z));
+    }
+}
+
+// Bins the primitive centroids of the node along each axis and finds the bin boundary with the lowest SAH cost
+// Returns false if no split is cheaper than keeping the node as a leaf
+bool BVH::findSAHSplit(const BVHNode& node, const std::vector<Vector3D>& minPoints, const std::vector<Vector3D>& maxPoints,
+    const std::vector<Vector3D>& centroids, uint32_t& axis, float& splitPosition) const {
+
+    Vector3D centroidMinPoint = Vector3D(INFINITY);
+    Vector3D centroidMaxPoint = Vector3D(-INFINITY);
+    for (uint32_t i = 0; i < node.count; i++) {
+        const Vector3D& centroid = centroids[primitiveIndices[node.leftOrFirst + i]];
+        centroidMinPoint = Vector3D(smaller(centroidMinPoint.x, centroid.x), smaller(centroidMinPoint.y, centroid.y), smaller(centroidMinPoint.z, centroid.z));
+        centroidMaxPoint = Vector3D(greater(centroidMaxPoint.x, centroid.x), greater(centroidMaxPoint.y, centroid.y), greater(centroidMaxPoint.z, centroid.z));
+    }
+
+    float bestCost = INFINITY;
+    bool found = false;
+
+    for (uint32_t currentAxis = 0; currentAxis < 3; currentAxis++) {
+        const float axisMin = (&centroidMinPoint.x)[currentAxis];
+        const float axisMax = (&centroidMaxPoint.x)[currentAxis];
+        if (axisMax - axisMin < EPSILON6) { // All centroids are on the same plane
+            continue;
+        }
+
+        Vector3D binMinPoints[BVH_BIN_COUNT];
+        Vector3D binMaxPoints[BVH_BIN_COUNT];
+        uint32_t binCounts[BVH_BIN_COUNT] = {0};
+        for (uint32_t i = 0; i < BVH_BIN_COUNT; i++) {
+            binMinPoints[i] = Vector3D(INFINITY);
+            binMaxPoints[i] = Vector3D(-INFINITY);
+        }
+
+        const float binsPerUnit = BVH_BIN_COUNT / (axisMax - axisMin);
+        for (uint32_t i = 0; i < node.count; i++) {
+            const uint32_t primitiveIndex = primitiveIndices[node.leftOrFirst + i];
+            const uint32_t bin = smaller((uint32_t)(((&centroids[primitiveIndex].x)[currentAxis] - axisMin) * binsPerUnit), BVH_BIN_COUNT - 1);
+            const Vector3D& minPoint = minPoints[primitiveIndex];
+            const Vector3D& maxPoint = maxPoints[primitiveIndex];
+
+            binCounts[bin]++;
+            binMinPoints[bin] = Vector3D(smaller(binMinPoints[bin].x, minPoint.x), smaller(binMinPoints[bin].y, minPoint.y), smaller(binMinPoints[bin].z, minPoint.z));
+            binMaxPoints[bin] = Vector3D(greater(binMaxPoints[bin].x, maxPoint.x), greater(binMaxPoints[bin].y, maxPoint.y), greater(binMaxPoints[bin].z, maxPoint.z));
+        }
+
+        // Sweep from the left and from the right to find the area and the primitive count on each side of every plane
+        float leftAreas[BVH_BIN_COUNT - 1];
+        uint32_t leftCounts[BVH_BIN_COUNT - 1];
+        Vector3D sweepMinPoint = Vector3D(INFINITY);
+        Vector3D sweepMaxPoint = Vector3D(-INFINITY);
+        uint32_t sweepCount = 0;
+        for (uint32_t i = 0; i < BVH_BIN_COUNT - 1; i++) {
+            sweepCount += binCounts[i];
+            sweepMinPoint = Vector3D(smaller(sweepMinPoint.x, binMinPoints[i].x), smaller(sweepMinPoint.y, binMinPoints[i].y), smaller(sweepMinPoint.z, binMinPoints[i].z));
+            sweepMaxPoint = Vector3D(greater(sweepMaxPoint.x, binMaxPoints[i].x), greater(sweepMaxPoint.y, binMaxPoints[i].y), greater(sweepMaxPoint.z, binMaxPoints[i].z));
+            leftCounts[i] = sweepCount;
+            leftAreas[i] = (sweepCount > 0) ? surfaceArea(sweepMinPoint, sweepMaxPoint) : 0.0f;
+        }
+
+        sweepMinPoint = Vector3D(INFINITY);
+        sweepMaxPoint = Vector3D(-INFINITY);
+        sweepCount = 0;
+        for (uint32_t i = BVH_BIN_COUNT - 1; i > 0; i--) {
+            sweepCount += binCounts[i];
+            sweepMinPoint = Vector3D(smaller(sweepMinPoint.x, binMinPoints[i].x), smaller(sweepMinPoint.y, binMinPoints[i].y), smaller(sweepMinPoint.z, binMinPoints[i].z));
+            sweepMaxPoint = Vector3D(greater(sweepMaxPoint.x, binMaxPoints[i].x), greater(sweepMaxPoint.y, binMaxPoints[i].y), greater(sweepMaxPoint.z, binMaxPoints[i].z));
+            if (leftCounts[i-1] == 0 || sweepCount == 0) {
+                continue;
+            }
+
+            const float cost = leftAreas[i-1] * blockCount(leftCounts[i-1]) + surfaceArea(sweepMinPoint, sweepMaxPoint) * blockCount(sweepCount);
+            if (cost < bestCost) {
+                bestCost = cost;
+                axis = currentAxis;
+                splitPosition = axisMin + i / binsPerUnit;
+                found = true;
+            }
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    // Large nodes are always split, small ones only if the split is cheaper than intersecting all of their primitives
+    const float splitCost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * bestCost / surfaceArea(node.minPoint, node.maxPoint);
+    const float leafCost = BVH_INTERSECTION_COST * blockCount(node.count);
+    return node.count > maxLeafSize || splitCost < leafCost;
+}
+
+// Splits the node at the given depth recursively, the children of every node are appended to subtreeNodes next to each other
+// The primitives of a large node are split between two threads if more than one thread is given
+void BVH::subdivide(std::vector<BVHNode>& subtreeNodes, uint32_t nodeIndex, const std::vector<Vector3D>& minPoints,
+    const std::vector<Vector3D>& maxPoints, const std::vector<Vector3D>& centroids, uint32_t threadCount, uint32_t depth) {
+
+    const uint32_t first = subtreeNodes[nodeIndex].leftOrFirst;
+    const uint32_t count = subtreeNodes[nodeIndex].count;
+    if (count <= 1) {
+        return;
+    }
+
+    uint32_t axis;
+    float splitPosition;
+    uint32_t leftCount;
+    if (depth >= BVH_MAX_SAH_DEPTH) {
+        if (count <= maxLeafSize) {
+            return;
+        }
+
+        // Split at the median centroid along the longest axis of the node, which bounds the depth of the subtree
+        const Vector3D extent = subtreeNodes[nodeIndex].maxPoint - subtreeNodes[nodeIndex].minPoint;
+        axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z) ? 1 : 2;
+        leftCount = count / 2;
+        std::nth_element(primitiveIndices.begin() + first, primitiveIndices.begin() + first + leftCount, 
+            primitiveIndices.begin() + first + count, [&](uint32_t a, uint32_t b) {
+                return (&centroids[a].x)[axis] < (&centroids[b].x)[axis];
+            });
+    } else if (findSAHSplit(subtreeNodes[nodeIndex], minPoints, maxPoints, centroids, axis, splitPosition)) {
+        // Move the primitives on the left of the split position to the beginning of the range
+        uint32_t i = first;
+        uint32_t j = first + count;
+        while (i < j) {
+            if ((&centroids[primitiveIndices[i]].x)[axis] < splitPosition) {
+                i++;
+            } else {
+                const uint32_t temp = primitiveIndices[i];
+                primitiveIndices[i] = primitiveIndices[--j];
+                primitiveIndices[j] = temp;
+            }
+        }
+        leftCount = i - first;
+
+        // Bin boundaries may be rounded differently than the centroids, split the range in half if a side is empty
+        if (leftCount == 0 || leftCount == count) {
+            leftCount = count / 2;
+        }
+    } else if (count > maxLeafSize) { // All centroids coincide, split the range in half
+        leftCount = count / 2;
+    } else {
+        return;
+    }
+
+    BVHNode leftNode = BVHNode{.leftOrFirst = first, .count = leftCount};
+    BVHNode rightNode = BVHNode{.leftOrFirst = first + leftCount, .count = count - leftCount};
+    updateNodeBounds(leftNode, minPoints, maxPoints);
+    updateNodeBounds(rightNode, minPoints, maxPoints);
+
+    const uint32_t leftIndex = subtreeNodes.size();
+    subtreeNodes[nodeIndex].leftOrFirst = leftIndex;
+    subtreeNodes[nodeIndex].count = 0;
+
+    if (threadCount > 1 && count >= BVH_PARALLEL_BUILD_THRESHOLD) {
+        // Both children are built in their own node arrays, since the children work on distinct primitive ranges
+        std::vector<BVHNode> leftNodes = {leftNode};
+        std::vector<BVHNode> rightNodes = {rightNode};
+        const uint32_t leftThreadCount = threadCount / 2;
+
+        std::thread leftThread = std::thread([&]() {
+            subdivide(leftNodes, 0, minPoints, maxPoints, centroids, leftThreadCount, depth + 1);
+        });
+        subdivide(rightNodes, 0, minPoints, maxPoints, centroids, threadCount - leftThreadCount, depth + 1);
+        leftThread.join();
+
+        subtreeNodes.push_back(leftNodes[0]);
+        subtreeNodes.push_back(rightNodes[0]);
+        appendSubtree(subtreeNodes, leftNodes, leftIndex);
+        appendSubtree(subtreeNodes, rightNodes, leftIndex + 1);
+    } else {
+        subtreeNodes.push_back(leftNode);
+        subtreeNodes.push_back(rightNode);
+        subdivide(subtreeNodes, leftIndex, minPoints, maxPoints, centroids, 1, depth + 1);
+        subdivide(subtreeNodes, leftIndex + 1, minPoints, maxPoints, centroids, 1, depth + 1);
+    }
+}
+
+// Returns the number of nodes on the longest path from the node to a leaf of the binary tree
+uint32_t BVH::findHeight(uint32_t nodeIndex) const {
+    const BVHNode& node = nodes[nodeIndex];
+    if (node.count > 0) {
+        return 1;
+    }
+    return 1 + greater(findHeight(node.leftOrFirst), findHeight(node.leftOrFirst + 1));
+}
+
+// Moves the descendants of a subtree which was built in a separate array, the root is already at rootIndex
+void BVH::appendSubtree(std::vector<BVHNode>& subtreeNodes, const std::vector<BVHNode>& childNodes, uint32_t rootIndex) {
+    // Node i > 0 of childNodes is moved to i + offset
+    const uint32_t offset = subtreeNodes.size() - 1;
+
+    if (childNodes[0].count == 0) {
+        subtreeNodes[rootIndex].leftOrFirst += offset;
+    }
+    for (uint32_t i = 1; i < childNodes.size(); i++) {
+        BVHNode node = childNodes[i];
+        if (node.count == 0) {
+            node.leftOrFirst += offset;
+        }
+        subtreeNodes.push_back(node);
+    }
+}
+
+// Moves the primitives of every leaf to a range which starts at a multiple of the leaf block size
+// so that each leaf maps to the block at index leftOrFirst / leafBlockSize
+void BVH::alignLeaves(void) {
+    std::vector<uint32_t> alignedPrimitiveIndices;
+    alignedPrimitiveIndices.reserve(primitiveIndices.size() + nodes.size() * (leafBlockSize - 1));
+
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].count == 0) {
+            continue;
+        }
+        assert(nodes[i].count <= leafBlockSize);
+
+        const uint32_t first = alignedPrimitiveIndices.size();
+        alignedPrimitiveIndices.insert(
+            alignedPrimitiveIndices.end(),
+            primitiveIndices.begin() + nodes[i].leftOrFirst,
+            primitiveIndices.begin() + nodes[i].leftOrFirst + nodes[i].count
+        );
+        alignedPrimitiveIndices.resize(first + leafBlockSize, BVH_INVALID_INDEX);
+        nodes[i].leftOrFirst = first;
+    }
+
+    primitiveIndices = alignedPrimitiveIndices;
+}
+
+// Collapses the binary subtree of an inner node into wide nodes and returns the index of its wide node
+// The inner child with the largest surface area is replaced by its children until there are four children
+uint32_t BVH::collapse(uint32_t nodeIndex) {
+    uint32_t children[4] = {nodes[nodeIndex].leftOrFirst, nodes[nodeIndex].leftOrFirst + 1};
+    uint32_t childCount = 2;
+
+    while (childCount < 4) {
+        int32_t largestChild = -1;
+        float largestArea = -INFINITY;
+        for (uint32_t i = 0; i < childCount; i++) {
+            const BVHNode& child = nodes[children[i]];
+            const float area = surfaceArea(child.minPoint, child.maxPoint);
+            if (child.count == 0 && area > largestArea) {
+                largestChild = i;
+                largestArea = area;
+            }
+        }
+
+        if (largestChild == -1) { // All children are leaves
+            break;
+        }
+        const uint32_t openedChild = children[largestChild];
+        children[largestChild] = nodes[openedChild].leftOrFirst;
+        children[childCount++] = nodes[openedChild].leftOrFirst + 1;
+    }
+
+    const uint32_t wideIndex = wideNodes.size();
+    wideNodes.push_back(BVHWideNode{.childCount = childCount});
+
+    for (uint32_t i = 0; i < childCount; i++) {
+        const BVHNode& child = nodes[children[i]];
+        setAABB4Lane(wideNodes[wideIndex].childBounds, i, child.minPoint, child.maxPoint);
+        wideNodes[wideIndex].counts[i] = child.count;
+
+        // The wide nodes may be reallocated while the child is collapsed, so index them again afterwards
+        const uint32_t childIndex = (child.count > 0) ? child.leftOrFirst : collapse(children[i]);
+        wideNodes[wideIndex].children[i] = childIndex;
+    }
+
+    return wideIndex;
+}
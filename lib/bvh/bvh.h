@@ -0,0 +1,259 @@
+
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+#include <thread>
+#include <stdint.h>
+#include <shape.h>
+#include <slab.h>
+
+#define BVH_MAX_LEAF_SIZE 4
+
+// Nodes deeper than BVH_MAX_SAH_DEPTH are split at the median, which halves them, so no path of the binary tree is longer
+// than BVH_MAX_DEPTH nodes for 32-bit primitive counts. A wide node pushes at most four children and keeps at most three
+// of them on the stack while its subtree is traversed, which bounds the traversal stack.
+#define BVH_MAX_SAH_DEPTH 32
+#define BVH_MAX_DEPTH     (BVH_MAX_SAH_DEPTH + 32)
+#define BVH_STACK_SIZE    (3 * BVH_MAX_DEPTH + 1)
+#define BVH_BIN_COUNT     16
+#define BVH_INVALID_INDEX UINT32_MAX
+
+// Relative costs of visiting an inner node and intersecting a primitive for the surface area heuristic
+#define BVH_TRAVERSAL_COST    1.0f
+#define BVH_INTERSECTION_COST 1.0f
+
+// Subtrees with fewer primitives than this are built by the thread which split their parent
+#define BVH_PARALLEL_BUILD_THRESHOLD 1024
+
+typedef struct {
+    Vector3D minPoint;
+    Vector3D maxPoint;
+    uint32_t leftOrFirst; // Index of the left child if count is 0, otherwise index of the first primitive
+    uint32_t count;       // Number of primitives in the leaf, 0 for inner nodes
+} BVHNode;
+
+// Node with up to four children whose boxes are tested at once
+typedef struct {
+    AABB4 childBounds;
+    uint32_t children[4]; // Index of the child node if counts[i] is 0, otherwise index of the first primitive
+    uint32_t counts[4];   // Number of primitives of the leaf children, 0 for inner children
+    uint32_t childCount;
+} BVHWideNode;
+
+// Bounding volume hierarchy over primitives which are referred by their indices
+// It is built as a binary tree which is then collapsed into a tree of wide nodes for traversal
+class BVH {
+private:
+    std::vector<BVHNode> nodes; // Binary nodes, only kept during the construction
+    std::vector<BVHWideNode> wideNodes;
+    std::vector<uint32_t> primitiveIndices;
+
+    Vector3D minPoint = Vector3D(INFINITY);
+    Vector3D maxPoint = Vector3D(-INFINITY);
+    float sahCost = 0.0f;
+
+    uint32_t leafBlockSize = 1; // Number of primitives which are intersected at once in a leaf
+    uint32_t maxLeafSize = BVH_MAX_LEAF_SIZE;
+
+    uint32_t blockCount(uint32_t count) const;
+    float calculateSAHCost(void) const;
+    void alignLeaves(void);
+    void finishConstruction(void);
+    uint32_t collapse(uint32_t nodeIndex);
+    uint32_t findHeight(uint32_t nodeIndex) const;
+    void updateNodeBounds(BVHNode& node, const std::vector<Vector3D>& minPoints, const std::vector<Vector3D>& maxPoints) const;
+    bool findSAHSplit(const BVHNode& node, const std::vector<Vector3D>& minPoints, const std::vector<Vector3D>& maxPoints,
+        const std::vector<Vector3D>& centroids, uint32_t& axis, float& splitPosition) const;
+    void subdivide(std::vector<BVHNode>& subtreeNodes, uint32_t nodeIndex, const std::vector<Vector3D>& minPoints,
+        const std::vector<Vector3D>& maxPoints, const std::vector<Vector3D>& centroids, uint32_t threadCount, uint32_t depth);
+
+    static float surfaceArea(const Vector3D& minPoint, const Vector3D& maxPoint);
+    static void appendSubtree(std::vector<BVHNode>& subtreeNodes, const std::vector<BVHNode>& childNodes, uint32_t rootIndex);
+
+public:
+    BVH();
+    BVH(const std::vector<Vector3D>& minPoints, const std::vector<Vector3D>& maxPoints, uint32_t threadCount = 1, uint32_t leafBlockSize_ = 1);
+
+    // Takes a binary tree which is built by the caller, such as the quadtree of a Bezier surface
+    // The children of an inner node are at leftOrFirst and leftOrFirst + 1, and the leaves refer to ranges of primitiveIndices_
+    // Throws std::invalid_argument if the tree is deeper than BVH_MAX_DEPTH
+    BVH(const std::vector<BVHNode>& nodes_, const std::vector<uint32_t>& primitiveIndices_, uint32_t leafBlockSize_ = 1);
+
+    uint32_t getNodeCount(void) const;
+    const std::vector<uint32_t>& getPrimitiveIndices(void) const;
+    float getSAHCost(void) const;
+    void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const;
+
+    // Visits the leaves that the ray enters before far, the closest leaf first unless closestFirst is false
+    // intersectLeaf(first, count, far) gets the range of the leaf in the primitive indices, 
+    // it may decrease far after a hit, and stops the traversal by returning true
+    // Any-hit queries, which stop at the first hit, do not need the order
+    template <bool closestFirst = true, typename Function>
+    void traverseLeaves(const Ray& ray, float& far, Function intersectLeaf) const;
+
+    // Visits the primitives of the leaves that the ray enters before far, the closest leaf first unless closestFirst is false
+    // intersectPrimitive(index, far) may decrease far after a hit, and stops the traversal by returning true
+    template <bool closestFirst = true, typename Function>
+    void traverse(const Ray& ray, float& far, Function intersectPrimitive) const;
+
+    // Visits the leaves that the frustum of the packet overlaps, the closest leaf to the apex first
+    // fars keeps the range of each ray of the packet, intersectLeaf(first, count) may decrease them after hits
+    // Subtrees which are farther from the apex than all ranges are skipped
+    template <typename Function>
+    void traversePacketLeaves(const RayPacket& packet, const float* fars, Function intersectLeaf) const;
+
+    template <typename Function>
+    void traversePacket(const RayPacket& packet, const float* fars, Function intersectPrimitive) const;
+};
+
+template <bool closestFirst, typename Function>
+void BVH::traverseLeaves(const Ray& ray, float& far, Function intersectLeaf) const {
+    if (wideNodes.empty()) {
+        return;
+    }
+
+    const InverseRay inverseRay = invertRay(ray);
+
+    // Each entry keeps a child slot (4 * node index + lane) and the distance at which the ray enters the child
+    uint32_t stackSlots[BVH_STACK_SIZE];
+    float stackTs[BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    while (true) {
+        const BVHWideNode& node = wideNodes[nodeIndex];
+        float ts[4];
+        uint32_t hitMask = intersectAABB4(node.childBounds, inverseRay, far, ts) & ((1 << node.childCount) - 1);
+
+        // Push the hit children in the order of their distances, so that the closest one is on the top
+        const uint32_t firstEntry = stackSize;
+        while (hitMask != 0) {
+            const uint32_t lane = __builtin_ctz(hitMask);
+            hitMask &= hitMask - 1;
+
+            assert(stackSize < BVH_STACK_SIZE);
+            uint32_t entry = stackSize++;
+            while (closestFirst && entry > firstEntry && stackTs[entry-1] < ts[lane]) {
+                stackSlots[entry] = stackSlots[entry-1];
+                stackTs[entry] = stackTs[entry-1];
+                entry--;
+            }
+            stackSlots[entry] = 4 * nodeIndex + lane;
+            stackTs[entry] = ts[lane];
+        }
+
+        // Pop the children which the ray still enters before far until an inner node is found
+        while (true) {
+            if (stackSize == 0) {
+                return;
+            }
+            stackSize--;
+            if (stackTs[stackSize] >= far) {
+                continue;
+            }
+
+            const BVHWideNode& parent = wideNodes[stackSlots[stackSize] >> 2];
+            const uint32_t lane = stackSlots[stackSize] & 3;
+            if (parent.counts[lane] == 0) {
+                nodeIndex = parent.children[lane];
+                break;
+            } else if (intersectLeaf(parent.children[lane], parent.counts[lane], far)) {
+                return;
+            }
+        }
+    }
+}
+
+template <bool closestFirst, typename Function>
+void BVH::traverse(const Ray& ray, float& far, Function intersectPrimitive) const {
+    traverseLeaves<closestFirst>(ray, far, [&](uint32_t first, uint32_t count, float& far) {
+        for (uint32_t i = first; i < first + count; i++) {
+            if (intersectPrimitive(primitiveIndices[i], far)) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+template <typename Function>
+void BVH::traversePacketLeaves(const RayPacket& packet, const float* fars, Function intersectLeaf) const {
+    if (wideNodes.empty()) {
+        return;
+    }
+
+    // A hit at distance t from the origin of a ray is at most t + maxOriginDistance away from the apex
+    const auto findMaxApexDistance = [&](void) {
+        float maxFar = 0.0f;
+        for (uint32_t i = 0; i < RAY_PACKET_SIZE; i++) {
+            maxFar = greater(maxFar, fars[i]);
+        }
+        return maxFar + packet.maxOriginDistance;
+    };
+    float maxApexDistance = findMaxApexDistance();
+
+    // Each entry keeps a child slot (4 * node index + lane) and the distance from the apex to the child
+    uint32_t stackSlots[BVH_STACK_SIZE];
+    float stackDistances[BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    while (true) {
+        const BVHWideNode& node = wideNodes[nodeIndex];
+        float distances[4];
+        uint32_t overlapMask = intersectFrustumAABB4(node.childBounds, packet.frustum, distances) & ((1 << node.childCount) - 1);
+
+        // Push the overlapped children in the order of their distances, so that the closest one is on the top
+        const uint32_t firstEntry = stackSize;
+        while (overlapMask != 0) {
+            const uint32_t lane = __builtin_ctz(overlapMask);
+            overlapMask &= overlapMask - 1;
+            if (distances[lane] >= maxApexDistance) {
+                continue;
+            }
+
+            assert(stackSize < BVH_STACK_SIZE);
+            uint32_t entry = stackSize++;
+            while (entry > firstEntry && stackDistances[entry-1] < distances[lane]) {
+                stackSlots[entry] = stackSlots[entry-1];
+                stackDistances[entry] = stackDistances[entry-1];
+                entry--;
+            }
+            stackSlots[entry] = 4 * nodeIndex + lane;
+            stackDistances[entry] = distances[lane];
+        }
+
+        // Pop the children which are still in the range until an inner node is found
+        while (true) {
+            if (stackSize == 0) {
+                return;
+            }
+            stackSize--;
+            if (stackDistances[stackSize] >= maxApexDistance) {
+                continue;
+            }
+
+            const BVHWideNode& parent = wideNodes[stackSlots[stackSize] >> 2];
+            const uint32_t lane = stackSlots[stackSize] & 3;
+            if (parent.counts[lane] == 0) {
+                nodeIndex = parent.children[lane];
+                break;
+            }
+
+            intersectLeaf(parent.children[lane], parent.counts[lane]);
+            maxApexDistance = findMaxApexDistance();
+        }
+    }
+}
+
+template <typename Function>
+void BVH::traversePacket(const RayPacket& packet, const float* fars, Function intersectPrimitive) const {
+    traversePacketLeaves(packet, fars, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            intersectPrimitive(primitiveIndices[i]);
+        }
+    });
+}
+
+#endif // __BVH_H__
@@ -40,3 +40,50 @@ Ray Camera::generateRay(float x, float y) const {
         .dir = pixelPositionWRTCameraPosition.normalize(),
     };
 }
+
+// Generates the rays through the centers of width x height pixels of the image, starting from the pixel (pixelX, pixelY)
+// The points are computed per pixel as for the single rays, so a pixel gets the same ray whichever packet it is in
+// The frustum of the packet contains the pixels
+RayPacket Camera::generateRayPacket(uint32_t pixelX, uint32_t pixelY, uint32_t imageWidth, uint32_t imageHeight, 
+    uint32_t width, uint32_t height) const {
+    assert(0 < width && width <= RAY_BLOCK_SIZE && 0 < height && height <= RAY_PACKET_HEIGHT);
+    assert(pixelX + width <= imageWidth && pixelY + height <= imageHeight);
+    const float dx = 1.0f / imageWidth;
+    const float dy = 1.0f / imageHeight;
+    RayPacket packet = {};
+
+    for (uint32_t j = 0; j < height; j++) {
+        const float y = 1.0f - (pixelY+j+0.5f) * dy;
+        for (uint32_t i = 0; i < width; i++) {
+            const float x = (pixelX+i+0.5f) * dx;
+            setRayBlockLane(packet.blocks[j], i, generateRay(x, y));
+        }
+    }
+
+    // Corners of the screen rectangle relative to the camera position, in the order around the rectangle
+    const float startX = pixelX * dx;
+    const float startY = 1.0f - pixelY * dy;
+    const float endX = (pixelX+width) * dx;
+    const float endY = 1.0f - (pixelY+height) * dy;
+    const Vector3D corners[4] = {
+        lowerLeft + rightPerX*startX + upPerY*startY,
+        lowerLeft + rightPerX*endX + upPerY*startY,
+        lowerLeft + rightPerX*endX + upPerY*endY,
+        lowerLeft + rightPerX*startX + upPerY*endY,
+    };
+
+    // The ray origins are on the screen, so the farthest one is at a corner
+    const Vector3D center = corners[0] + corners[2];
+    packet.frustum.apex = position;
+    packet.maxOriginDistance = 0.0f;
+    for (uint32_t i = 0; i < 4; i++) {
+        Vector3D normal = corners[i].cross(corners[(i+1) % 4]);
+        if (normal.dot(center) < 0.0f) {
+            normal *= -1.0f;
+        }
+        packet.frustum.planeNormals[i] = normal;
+        packet.maxOriginDistance = greater(packet.maxOriginDistance, corners[i].mag());
+    }
+
+    return packet;
+}
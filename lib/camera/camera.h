@@ -4,6 +4,7 @@
 
 #include <color.h>
 #include <vector3d.h>
+#include <ray_packet.h>
 
 class Camera {
 private:
@@ -27,6 +28,8 @@ public:
     float getFar(void) const;
 
     Ray generateRay(float x, float y) const;
+    RayPacket generateRayPacket(uint32_t pixelX, uint32_t pixelY, uint32_t imageWidth, uint32_t imageHeight, 
+        uint32_t width, uint32_t height) const;
 };
 
 #endif // __CAMERA_H__
@@ -0,0 +1,99 @@
+
+#include "linear_color.h"
+
+#ifdef CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Both types are packed channels, so the buffers are processed as flat arrays of channels
+static_assert(sizeof(LinearColor) == 3 * sizeof(float), "LinearColor must not be padded");
+static_assert(sizeof(Color) == 3 * sizeof(uint8_t), "Color must not be padded");
+
+// Quantizes the channels in [first, channelCount) one by one
+static void resolveChannelsScalar(const float* channels, uint8_t* quantizedChannels, uint32_t first, uint32_t channelCount) {
+    for (uint32_t i = first; i < channelCount; i++) {
+        const float value = channels[i] * 255.0f;
+        const float clampedValue = (value < 0.0f) ? 0.0f : (value > 255.0f) ? 255.0f : value;
+        quantizedChannels[i] = static_cast<uint8_t>(clampedValue + 0.5f);
+    }
+}
+
+#ifdef CPU_DISPATCH
+
+// The vector variants quantize as many channels as their width allows and leave the rest to the scalar loop
+// They add a half and truncate like the scalar loop, so every path rounds the halves up and gives the same bytes
+
+__attribute__((target("sse4.2")))
+static uint32_t resolveChannelsSSE42(const float* channels, uint8_t* quantizedChannels, uint32_t channelCount) {
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    uint32_t i = 0;
+
+    for (; i + 8 <= channelCount; i += 8) {
+        const __m128 low = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(channels + i), scale), zero), scale);
+        const __m128 high = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(channels + i + 4), scale), zero), scale);
+
+        const __m128i shorts = _mm_packus_epi32(_mm_cvttps_epi32(_mm_add_ps(low, half)), _mm_cvttps_epi32(_mm_add_ps(high, half)));
+        _mm_storel_epi64((__m128i*)(quantizedChannels + i), _mm_packus_epi16(shorts, shorts));
+    }
+    return i;
+}
+
+__attribute__((target("avx2,fma")))
+static uint32_t resolveChannelsAVX2(const float* channels, uint8_t* quantizedChannels, uint32_t channelCount) {
+    const __m256 scale = _mm256_set1_ps(255.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    uint32_t i = 0;
+
+    for (; i + 8 <= channelCount; i += 8) {
+        const __m256 values = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(channels + i), scale), zero), scale);
+
+        const __m256i integers = _mm256_cvttps_epi32(_mm256_add_ps(values, half));
+        const __m128i shorts = _mm_packus_epi32(_mm256_castsi256_si128(integers), _mm256_extracti128_si256(integers, 1));
+        _mm_storel_epi64((__m128i*)(quantizedChannels + i), _mm_packus_epi16(shorts, shorts));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512vl")))
+static uint32_t resolveChannelsAVX512(const float* channels, uint8_t* quantizedChannels, uint32_t channelCount) {
+    const __m512 scale = _mm512_set1_ps(255.0f);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 half = _mm512_set1_ps(0.5f);
+    uint32_t i = 0;
+
+    for (; i + 16 <= channelCount; i += 16) {
+        const __m512 values = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(channels + i), scale), zero), scale);
+        _mm_storeu_si128((__m128i*)(quantizedChannels + i), _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(_mm512_add_ps(values, half))));
+    }
+    return i;
+}
+
+#endif // CPU_DISPATCH
+
+void resolveLinearColors(const LinearColor* linearColors, Color* colors, uint32_t count) {
+    const float* channels = reinterpret_cast<const float*>(linearColors);
+    uint8_t* quantizedChannels = reinterpret_cast<uint8_t*>(colors);
+    const uint32_t channelCount = 3 * count;
+    uint32_t first = 0;
+
+#ifdef CPU_DISPATCH
+    switch (getCPUPath()) {
+    case CPU_PATH_AVX512:
+        first = resolveChannelsAVX512(channels, quantizedChannels, channelCount);
+        break;
+    case CPU_PATH_AVX2:
+        first = resolveChannelsAVX2(channels, quantizedChannels, channelCount);
+        break;
+    case CPU_PATH_SSE42:
+        first = resolveChannelsSSE42(channels, quantizedChannels, channelCount);
+        break;
+    default:
+        break;
+    }
+#endif
+
+    resolveChannelsScalar(channels, quantizedChannels, first, channelCount);
+}
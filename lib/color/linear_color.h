@@ -0,0 +1,55 @@
+
+#ifndef __LINEAR_COLOR_H__
+#define __LINEAR_COLOR_H__
+
+#include "color.h"
+#include <cpu.h>
+
+// Color with float channels in linear scale, where 1.0f is the brightest displayable value
+// Shading is accumulated in this type without clamping, the channels are quantized once when the image is written
+// The operators are defined in the header so that they are inlined into the shading code
+class LinearColor {
+public:
+    float red;
+    float green;
+    float blue;
+
+    LinearColor() : red(0.0f), green(0.0f), blue(0.0f) {}
+    LinearColor(float red_, float green_, float blue_) : red(red_), green(green_), blue(blue_) {}
+    LinearColor(const Color& color) : red(color.red / 255.0f), green(color.green / 255.0f), blue(color.blue / 255.0f) {}
+
+    LinearColor operator + (const LinearColor& other) const {
+        return LinearColor(red + other.red, green + other.green, blue + other.blue);
+    }
+
+    void operator += (const LinearColor& other) {
+        red += other.red;
+        green += other.green;
+        blue += other.blue;
+    }
+
+    LinearColor operator * (float scalar) const {
+        return LinearColor(red * scalar, green * scalar, blue * scalar);
+    }
+
+    void operator *= (float scalar) {
+        red *= scalar;
+        green *= scalar;
+        blue *= scalar;
+    }
+
+    LinearColor operator * (const LinearColor& other) const {
+        return LinearColor(red * other.red, green * other.green, blue * other.blue);
+    }
+
+    void operator *= (const LinearColor& other) {
+        red *= other.red;
+        green *= other.green;
+        blue *= other.blue;
+    }
+};
+
+// Clamps the channels to [0, 1] and quantizes them to 8 bits with the variant of the active CPU path
+void resolveLinearColors(const LinearColor* linearColors, Color* colors, uint32_t count);
+
+#endif // __LINEAR_COLOR_H__
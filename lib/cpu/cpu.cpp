@@ -0,0 +1,45 @@
+
+#include "cpu.h"
+#include <string.h>
+
+static const char* const cpuPathNames[CPU_PATH_COUNT] = {"scalar", "sse4.2", "avx2", "avx512"};
+
+CPUPath activeCPUPath = detectCPUPath();
+
+bool setCPUPath(CPUPath path) {
+    if (path > detectCPUPath()) {
+        return false;
+    }
+    activeCPUPath = path;
+    return true;
+}
+
+CPUPath detectCPUPath(void) {
+#ifdef CPU_DISPATCH
+    // The builtins also check that the OS saves the wide registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")) {
+        return CPU_PATH_AVX512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return CPU_PATH_AVX2;
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        return CPU_PATH_SSE42;
+    }
+#endif
+    return CPU_PATH_SCALAR;
+}
+
+const char* getCPUPathName(CPUPath path) {
+    assert(path < CPU_PATH_COUNT);
+    return cpuPathNames[path];
+}
+
+bool parseCPUPath(const char* name, CPUPath& path) {
+    for (uint32_t i = 0; i < CPU_PATH_COUNT; i++) {
+        if (strcmp(name, cpuPathNames[i]) == 0) {
+            path = (CPUPath)i;
+            return true;
+        }
+    }
+    return false;
+}
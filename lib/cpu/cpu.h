@@ -0,0 +1,40 @@
+
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include <stdint.h>
+#include <assert.h>
+
+// The SIMD kernels are compiled for each instruction set on x86 and chosen at startup
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_DISPATCH
+#endif
+
+// Kernel variants from the slowest to the fastest, a CPU which supports a path supports the ones before it as well
+typedef enum {
+    CPU_PATH_SCALAR,
+    CPU_PATH_SSE42,
+    CPU_PATH_AVX2,   // AVX2 with FMA
+    CPU_PATH_AVX512, // AVX-512 F and VL
+    CPU_PATH_COUNT,
+} CPUPath;
+
+// Path that the kernels use, the best one which the CPU supports unless it is overridden by setCPUPath
+extern CPUPath activeCPUPath;
+
+inline CPUPath getCPUPath(void) {
+    return activeCPUPath;
+}
+
+// Returns false if the CPU does not support the path
+bool setCPUPath(CPUPath path);
+
+// Finds the best path with cpuid
+CPUPath detectCPUPath(void);
+
+const char* getCPUPathName(CPUPath path);
+
+// Finds the path whose name is given, returns false if there is no such path
+bool parseCPUPath(const char* name, CPUPath& path);
+
+#endif // __CPU_H__
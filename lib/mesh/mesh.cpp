@@ -1,76 +1,132 @@
 
 #include "mesh.h"
 
-Mesh::Mesh(const std::vector<Shape*>& shapes_) : Shape(), shapes(shapes_) {
-    Vector3D minPoint;
-    Vector3D maxPoint;
-    findAABBMinMaxPoints(minPoint, maxPoint);
-    boundingVolume.setMinPoint(minPoint);
-    boundingVolume.setMaxPoint(maxPoint);
-}
+Mesh::Mesh(const std::vector<Shape*>& shapes_, uint32_t threadCount) : Shape() {
+    for (uint32_t i = 0; i < shapes_.size(); i++) {
+        addShape(shapes_[i]);
+    }
 
-bool Mesh::intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const {
-    if (!boundingVolume.intersect(NULL, NULL, ray, far)) {
-        return false;
+    std::vector<Vector3D> minPoints(references.size());
+    std::vector<Vector3D> maxPoints(references.size());
+    for (uint32_t i = 0; i < references.size(); i++) {
+        visitPrimitive(references[i], [&](const auto& primitive) {
+            primitive.findAABBMinMaxPoints(minPoints[i], maxPoints[i]);
+        });
     }
+    shapeBVH = BVH(minPoints, maxPoints, threadCount);
 
-    if (intersect == NULL) {
-        for (uint32_t i = 0; i < shapes.size(); i++) {
-            if (shapes[i]->intersect(NULL, intersectedShape, ray, far)) {
-                return true;
-            }
+    // Reorder the references as the primitives of the leaves, so that a leaf is a range of the references
+    const std::vector<uint32_t>& primitiveIndices = shapeBVH.getPrimitiveIndices();
+    std::vector<PrimitiveReference> leafReferences(references.size());
+    for (uint32_t i = 0; i < references.size(); i++) {
+        leafReferences[i] = references[primitiveIndices[i]];
+    }
+    references = leafReferences;
+}
+
+// Adds the shape to the array of its type, the primitives of a nested mesh are added instead of the mesh
+void Mesh::addShape(const Shape* shape) {
+    const Mesh* mesh = dynamic_cast<const Mesh*>(shape);
+    const Sphere* sphere = dynamic_cast<const Sphere*>(shape);
+    const AABB* aabb = dynamic_cast<const AABB*>(shape);
+    const Triangle* triangle = dynamic_cast<const Triangle*>(shape);
+    const BezierSurface* surface = dynamic_cast<const BezierSurface*>(shape);
+
+    if (mesh != NULL) {
+        for (uint32_t i = 0; i < mesh->references.size(); i++) {
+            addPrimitive(*mesh, mesh->references[i]);
         }
+    } else if (sphere != NULL) {
+        references.push_back(makePrimitiveReference(PRIMITIVE_SPHERE, spheres.size()));
+        spheres.push_back(*sphere);
+    } else if (aabb != NULL) {
+        references.push_back(makePrimitiveReference(PRIMITIVE_AABB, aabbs.size()));
+        aabbs.push_back(*aabb);
+    } else if (triangle != NULL) {
+        references.push_back(makePrimitiveReference(PRIMITIVE_TRIANGLE, triangles.size()));
+        triangles.push_back(*triangle);
+    } else if (surface != NULL) {
+        references.push_back(makePrimitiveReference(PRIMITIVE_BEZIER_SURFACE, surfaces.size()));
+        surfaces.push_back(surface);
     } else {
-        Intersect closestIntersect = {.t = INFINITY};
-        Intersect currentIntersect;
-        Shape* closestShape = NULL;
-        Shape* currentShape;
-
-        for (uint32_t i = 0; i < shapes.size(); i++) {
-            if (shapes[i]->intersect(&currentIntersect, &currentShape, ray, far) && currentIntersect.t < closestIntersect.t) {
-                closestIntersect = currentIntersect;
-                closestShape = currentShape;
+        references.push_back(makePrimitiveReference(PRIMITIVE_SHAPE, shapes.size()));
+        shapes.push_back(shape);
+    }
+}
+
+// Adds a primitive of a nested mesh
+void Mesh::addPrimitive(const Mesh& mesh, PrimitiveReference reference) {
+    mesh.visitPrimitive(reference, [&](const auto& primitive) {
+        addShape(&primitive);
+    });
+}
+
+const BVH& Mesh::getBVH(void) const {
+    return shapeBVH;
+}
+
+bool Mesh::intersect(Hit* hit, const Ray& ray, float far) const {
+    assert(hit != NULL);
+    bool hitFound = false;
+
+    // Every hit is closer than the previous ones since the range shrinks after each hit
+    shapeBVH.traverseLeaves(ray, far, [&](uint32_t first, uint32_t count, float& far) {
+        for (uint32_t i = first; i < first + count; i++) {
+            const bool primitiveHit = visitPrimitive(references[i], [&](const auto& primitive) {
+                return primitive.intersect(hit, ray, far);
+            });
+
+            if (primitiveHit) {
+                hitFound = true;
+                far = hit->t;
             }
         }
+        return false;
+    });
+
+    return hitFound;
+}
+
+// The hit is recorded by the primitive in the mesh which owns it
+Intersect Mesh::getIntersect(const Hit& hit, const Ray& ray) const {
+    assert(hit.shape != NULL && hit.shape != this);
+    return hit.shape->getIntersect(hit, ray);
+}
 
-        if (closestShape != NULL) {
-            *intersect = closestIntersect;
-            *intersectedShape = closestShape;
-            return true;
+// The primitives are culled with the frustum of the packet in the hierarchy
+// Bezier surfaces test the packet against their own hierarchies, the other primitives are tested ray by ray
+void Mesh::intersectPacket(Hit* hits, float* fars, const RayPacket& packet) const {
+    shapeBVH.traversePacketLeaves(packet, fars, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            const uint32_t index = getPrimitiveIndex(references[i]);
+            switch (getPrimitiveType(references[i])) {
+                case PRIMITIVE_BEZIER_SURFACE:
+                    surfaces[index]->intersectPacket(hits, fars, packet);
+                    break;
+                case PRIMITIVE_SHAPE:
+                    shapes[index]->intersectPacket(hits, fars, packet);
+                    break;
+                default:
+                    visitPrimitive(references[i], [&](const auto& primitive) {
+                        intersectPacketRays(primitive, hits, fars, packet);
+                    });
+                    break;
+            }
         }
-    }
+    });
+}
 
-    return false;
+// Stops at the first primitive that blocks the ray, the primitives are visited in any order
+bool Mesh::occluded(Shape** occludingShape, const Ray& ray, float far) const {
+    bool hit = false;
+    traverseOccluders(ray, far, [&](const Shape* shape) {
+        *occludingShape = (Shape*)shape;
+        hit = true;
+        return true;
+    });
+    return hit;
 }
 
 void Mesh::findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const {
-    minPoint = Vector3D(INFINITY);
-    maxPoint = Vector3D(-INFINITY);
-
-    Vector3D currentMinPoint;
-    Vector3D currentMaxPoint;
-
-    for (uint32_t i = 0; i < shapes.size(); i++) {
-        shapes[i]->findAABBMinMaxPoints(currentMinPoint, currentMaxPoint);
-
-        if (currentMinPoint.x < minPoint.x) {
-            minPoint.x = currentMinPoint.x;
-        } 
-        if (currentMinPoint.y < minPoint.y) {
-            minPoint.y = currentMinPoint.y;
-        } 
-        if (currentMinPoint.z < minPoint.z) {
-            minPoint.z = currentMinPoint.z;
-        } 
-
-        if (currentMaxPoint.x > maxPoint.x) {
-            maxPoint.x = currentMaxPoint.x;
-        }
-        if (currentMaxPoint.y > maxPoint.y) {
-            maxPoint.y = currentMaxPoint.y;
-        }
-        if (currentMaxPoint.z > maxPoint.z) {
-            maxPoint.z = currentMaxPoint.z;
-        }
-    }
+    shapeBVH.findAABBMinMaxPoints(minPoint, maxPoint);
 }
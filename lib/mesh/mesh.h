@@ -3,18 +3,108 @@
 #define __MESH_H__
 
 #include <vector>
+#include <sphere.h>
 #include <aabb.h>
+#include <bezier.h>
+#include <bvh.h>
 
-class Mesh : public Shape {
+// Reference to a primitive of a mesh, the type of the primitive is kept in the top bits and its index in the array of the type in the rest
+typedef uint32_t PrimitiveReference;
+
+#define PRIMITIVE_TYPE_SHIFT 29
+#define PRIMITIVE_INDEX_MASK ((1U << PRIMITIVE_TYPE_SHIFT) - 1)
+
+typedef enum {
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_AABB,
+    PRIMITIVE_TRIANGLE,
+    PRIMITIVE_BEZIER_SURFACE,
+    PRIMITIVE_SHAPE, // Any other shape, which is called through its virtual functions
+} PrimitiveType;
+
+// Nested meshes are flattened into a single top-level hierarchy over their primitives.
+// Spheres, boxes and triangles are copied into an array per type, and the leaves of the hierarchy refer to them by tagged references,
+// so the traversal switches on the type and calls the final classes directly instead of going through the virtual functions.
+// Rays that reach a Bezier surface continue in its bottom-level hierarchy through a direct call.
+class Mesh final : public Shape {
 private:
-    const std::vector<Shape*>& shapes;
-    AABB boundingVolume;
+    std::vector<Sphere> spheres;
+    std::vector<AABB> aabbs;
+    std::vector<Triangle> triangles;
+    std::vector<const BezierSurface*> surfaces;
+    std::vector<const Shape*> shapes;
+    std::vector<PrimitiveReference> references; // In the order of the primitives in the leaves of the hierarchy
+    BVH shapeBVH;
+
+    void addShape(const Shape* shape);
+    void addPrimitive(const Mesh& mesh, PrimitiveReference reference);
+
+    // Calls visit with the primitive as its final type, except for the shapes of unknown types
+    template <typename Function>
+    auto visitPrimitive(PrimitiveReference reference, Function visit) const;
 
 public:
-    Mesh(const std::vector<Shape*>& shapes_);
+    Mesh(const std::vector<Shape*>& shapes_, uint32_t threadCount = 1);
+
+    const BVH& getBVH(void) const;
 
-    bool intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const override;
+    bool intersect(Hit* hit, const Ray& ray, float far) const override;
+    Intersect getIntersect(const Hit& hit, const Ray& ray) const override;
+    void intersectPacket(Hit* hits, float* fars, const RayPacket& packet) const override;
+    bool occluded(Shape** occludingShape, const Ray& ray, float far) const override;
     void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const override;
+
+    // Visits the primitives which block the ray in (0, far) in any order
+    // visitOccluder(occludingShape) stops the traversal by returning true
+    template <typename Function>
+    void traverseOccluders(const Ray& ray, float far, Function visitOccluder) const;
 };
 
+inline PrimitiveReference makePrimitiveReference(PrimitiveType type, uint32_t index) {
+    assert(index <= PRIMITIVE_INDEX_MASK);
+    return ((uint32_t)type << PRIMITIVE_TYPE_SHIFT) | index;
+}
+
+inline PrimitiveType getPrimitiveType(PrimitiveReference reference) {
+    return (PrimitiveType)(reference >> PRIMITIVE_TYPE_SHIFT);
+}
+
+inline uint32_t getPrimitiveIndex(PrimitiveReference reference) {
+    return reference & PRIMITIVE_INDEX_MASK;
+}
+
+template <typename Function>
+auto Mesh::visitPrimitive(PrimitiveReference reference, Function visit) const {
+    const uint32_t index = getPrimitiveIndex(reference);
+    switch (getPrimitiveType(reference)) {
+        case PRIMITIVE_SPHERE:
+            return visit(spheres[index]);
+        case PRIMITIVE_AABB:
+            return visit(aabbs[index]);
+        case PRIMITIVE_TRIANGLE:
+            return visit(triangles[index]);
+        case PRIMITIVE_BEZIER_SURFACE:
+            return visit(*surfaces[index]);
+        default:
+            return visit(*shapes[index]);
+    }
+}
+
+template <typename Function>
+void Mesh::traverseOccluders(const Ray& ray, float far, Function visitOccluder) const {
+    shapeBVH.traverseLeaves<false>(ray, far, [&](uint32_t first, uint32_t count, float& far) {
+        for (uint32_t i = first; i < first + count; i++) {
+            Shape* occludingShape = NULL;
+            const bool blocked = visitPrimitive(references[i], [&](const auto& primitive) {
+                return primitive.occluded(&occludingShape, ray, far);
+            });
+
+            if (blocked && visitOccluder((const Shape*)occludingShape)) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
 #endif // __MESH_H__
@@ -0,0 +1,105 @@
+
+#include "scheduler.h"
+
+TileScheduler::TileScheduler(uint32_t imageWidth, uint32_t imageHeight, uint32_t tileSize, uint32_t threadCount_)
+    : queues(threadCount_), threadStats(threadCount_), threadCount(threadCount_) {
+    assert(tileSize > 0 && threadCount > 0);
+
+    // Tiles are created in row-major order and dealt in contiguous runs, so that each thread starts on nearby pixels
+    std::vector<Tile> tiles;
+    for (uint32_t y = 0; y < imageHeight; y += tileSize) {
+        for (uint32_t x = 0; x < imageWidth; x += tileSize) {
+            tiles.push_back(Tile{
+                .startX = x,
+                .startY = y,
+                .endX = (x + tileSize < imageWidth) ? x + tileSize : imageWidth,
+                .endY = (y + tileSize < imageHeight) ? y + tileSize : imageHeight,
+            });
+        }
+    }
+
+    const uint32_t tileCount = tiles.size();
+    for (uint32_t i = 0; i < threadCount; i++) {
+        const uint32_t first = (uint64_t)tileCount * i / threadCount;
+        const uint32_t last = (uint64_t)tileCount * (i + 1) / threadCount;
+        queues[i].tiles.assign(tiles.begin() + first, tiles.begin() + last);
+    }
+}
+
+uint32_t TileScheduler::getThreadCount(void) const {
+    return threadCount;
+}
+
+const std::vector<ThreadStats>& TileScheduler::getThreadStats(void) const {
+    return threadStats;
+}
+
+// Takes the next tile from the front of the own queue
+bool TileScheduler::popTile(uint32_t threadIndex, Tile& tile) {
+    TileQueue& queue = queues[threadIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return false;
+    }
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return true;
+}
+
+// Takes a tile from the back of another queue, which is the farthest from the tile that its owner renders
+bool TileScheduler::stealTile(uint32_t threadIndex, Tile& tile) {
+    for (uint32_t i = 1; i < threadCount; i++) {
+        TileQueue& queue = queues[(threadIndex + i) % threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tiles.empty()) {
+            tile = queue.tiles.back();
+            queue.tiles.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TileScheduler::threadFunction(uint32_t threadIndex, const std::function<void(const Tile&, uint32_t)>& renderTile) {
+    std::chrono::steady_clock::duration busy = std::chrono::steady_clock::duration::zero();
+    uint32_t tileCount = 0;
+
+    // No tile is added after the start, so a thread can quit once all queues are empty
+    Tile tile;
+    while (popTile(threadIndex, tile) || stealTile(threadIndex, tile)) {
+        const std::chrono::steady_clock::time_point tileStart = std::chrono::steady_clock::now();
+        renderTile(tile, threadIndex);
+        busy += std::chrono::steady_clock::now() - tileStart;
+        tileCount++;
+    }
+
+    // Idle time is known once the slowest thread finishes
+    threadStats[threadIndex] = ThreadStats{
+        .busySeconds = std::chrono::duration<float>(busy).count(),
+        .idleSeconds = 0.0f,
+        .tileCount = tileCount,
+    };
+}
+
+void TileScheduler::run(const std::function<void(const Tile&, uint32_t)>& renderTile) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads[i] = std::thread(&TileScheduler::threadFunction, this, i, std::cref(renderTile));
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads[i].join();
+    }
+
+    // Time spent on finding tiles and waiting for the slowest thread to finish
+    const float totalSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threadStats[i].idleSeconds = totalSeconds - threadStats[i].busySeconds;
+    }
+}
+
+uint32_t TileScheduler::getHardwareThreadCount(void) {
+    const uint32_t hardwareThreadCount = std::thread::hardware_concurrency();
+    return (hardwareThreadCount > 0) ? hardwareThreadCount : 1;
+}
@@ -0,0 +1,62 @@
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <assert.h>
+
+#define SCHEDULER_DEFAULT_TILE_SIZE 16
+
+// Rectangle of pixels in [startX, endX) x [startY, endY)
+typedef struct {
+    uint32_t startX;
+    uint32_t startY;
+    uint32_t endX;
+    uint32_t endY;
+} Tile;
+
+typedef struct {
+    float busySeconds; // Time spent on rendering tiles
+    float idleSeconds; // Time spent on finding tiles and waiting for the other threads to finish
+    uint32_t tileCount;
+} ThreadStats;
+
+// Splits the image into tiles and renders them with a pool of threads
+// Each thread starts with a contiguous run of tiles and steals from the others once its own tiles are finished,
+// so that the threads which get cheap tiles help the ones which get expensive tiles
+class TileScheduler {
+private:
+    // Aligned to a cache line, so that the locks of different threads do not share one
+    struct alignas(64) TileQueue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    std::vector<TileQueue> queues;
+    std::vector<ThreadStats> threadStats;
+    const uint32_t threadCount;
+
+    bool popTile(uint32_t threadIndex, Tile& tile);
+    bool stealTile(uint32_t threadIndex, Tile& tile);
+    void threadFunction(uint32_t threadIndex, const std::function<void(const Tile&, uint32_t)>& renderTile);
+
+public:
+    TileScheduler(uint32_t imageWidth, uint32_t imageHeight, uint32_t tileSize, uint32_t threadCount_);
+
+    uint32_t getThreadCount(void) const;
+    const std::vector<ThreadStats>& getThreadStats(void) const;
+
+    // Calls renderTile(tile, threadIndex) for every tile of the image and returns when all of them are rendered
+    void run(const std::function<void(const Tile&, uint32_t)>& renderTile);
+
+    // Returns the number of hardware threads, or 1 if it cannot be detected
+    static uint32_t getHardwareThreadCount(void);
+};
+
+#endif // __SCHEDULER_H__
@@ -0,0 +1,36 @@
+
+#include "material.h"
+
+// The table is created on its first use, since shapes may be constructed during the static initialization
+static std::vector<Material>& getMaterialTable(void) {
+    static std::vector<Material> materialTable;
+    return materialTable;
+}
+
+uint32_t addMaterial(const Color& color, float reflectivity, float transparency, float refractiveIndex) {
+    std::vector<Material>& materialTable = getMaterialTable();
+    for (uint32_t i = 0; i < materialTable.size(); i++) {
+        const Material& material = materialTable[i];
+        if (material.color == &color && material.reflectivity == reflectivity && 
+            material.transparency == transparency && material.refractiveIndex == refractiveIndex) {
+            return i;
+        }
+    }
+
+    materialTable.push_back(Material{
+        .color = &color, 
+        .reflectivity = reflectivity, 
+        .transparency = transparency, 
+        .refractiveIndex = refractiveIndex,
+    });
+    return materialTable.size() - 1;
+}
+
+const Material& getMaterial(uint32_t index) {
+    assert(index < getMaterialTable().size());
+    return getMaterialTable()[index];
+}
+
+uint32_t getMaterialCount(void) {
+    return getMaterialTable().size();
+}
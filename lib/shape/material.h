@@ -0,0 +1,25 @@
+
+#ifndef __MATERIAL_H__
+#define __MATERIAL_H__
+
+#include <vector>
+#include <stdint.h>
+#include <color.h>
+
+// Surface properties which are shared by the primitives of a shape and looked up only for shading
+typedef struct {
+    const Color* color;
+    float reflectivity;
+    float transparency;
+    float refractiveIndex;
+} Material;
+
+// Returns the index of the material in the shared table, identical materials are added once
+uint32_t addMaterial(const Color& color, float reflectivity, float transparency, float refractiveIndex);
+
+// Materials are only added while the scene is built, so the references stay valid during rendering
+const Material& getMaterial(uint32_t index);
+
+uint32_t getMaterialCount(void);
+
+#endif // __MATERIAL_H__
@@ -1,28 +1,44 @@
 
 #include "shape.h"
 
-Shape::Shape() : color(Color::Black), reflectivity(0.0f), transparency(0.0f), refractiveIndex(VACUUM_REFRACTIVE_INDEX) {}
+Shape::Shape() : materialIndex(addMaterial(Color::Black, 0.0f, 0.0f, VACUUM_REFRACTIVE_INDEX)) {}
 
-Shape::Shape(const Color& color_, float reflectivity_, float transparency_, float refractiveIndex_) 
-    : color(color_), reflectivity(reflectivity_), transparency(transparency_), refractiveIndex(refractiveIndex_) {
+Shape::Shape(const Color& color, float reflectivity, float transparency, float refractiveIndex) 
+    : materialIndex(addMaterial(color, reflectivity, transparency, refractiveIndex)) {
     
-    assert(0.0f <= reflectivity_ && 0.0f <= transparency_);
-    assert(reflectivity_ + transparency_ < 1.0f);
-    assert(refractiveIndex_ >= VACUUM_REFRACTIVE_INDEX);
+    assert(0.0f <= reflectivity && 0.0f <= transparency);
+    assert(reflectivity + transparency < 1.0f);
+    assert(refractiveIndex >= VACUUM_REFRACTIVE_INDEX);
+}
+
+Shape::Shape(uint32_t materialIndex_) : materialIndex(materialIndex_) {
+    assert(materialIndex_ < getMaterialCount());
+}
+
+uint32_t Shape::getMaterialIndex(void) const {
+    return materialIndex;
+}
+
+const Material& Shape::getMaterial(void) const {
+    return ::getMaterial(materialIndex);
 }
 
 float Shape::getTransparency(void) const {
-    return transparency;
+    return getMaterial().transparency;
 }
 
 float Shape::getReflectivity(void) const {
-    return reflectivity;
+    return getMaterial().reflectivity;
 }
 
 float Shape::getRefractiveIndex(void) const {
-    return refractiveIndex;
+    return getMaterial().refractiveIndex;
 }
 
 const Color& Shape::getColor(void) const {
-    return color;
+    return *getMaterial().color;
+}
+
+void Shape::intersectPacket(Hit* hits, float* fars, const RayPacket& packet) const {
+    intersectPacketRays(*this, hits, fars, packet);
 }
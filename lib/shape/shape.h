@@ -4,6 +4,8 @@
 
 #include <color.h>
 #include <vector3d.h>
+#include <ray_packet.h>
+#include "material.h"
 
 #define DIFFUSE_COEF   0.9f
 #define SPECULAR_COEF  0.5f
@@ -31,24 +33,67 @@ typedef struct {
     Vector3D normal;
 } Intersect;
 
+class Shape;
+
+// The minimal record of the closest hit, the intersection details are computed once for the final one
+typedef struct {
+    float t;
+    const Shape* shape;      // The shape which owns the primitive that is hit
+    uint32_t primitiveIndex; // Index of the primitive in the shape, 0 for the shapes with a single primitive
+    float beta;              // Barycentric coordinates of the hit point on triangles
+    float gamma;
+} Hit;
+
+// Shapes keep only their geometry and the index of their material in the shared table
 class Shape {
 private:
-    const Color& color;
-    const float reflectivity;
-    const float transparency;
-    const float refractiveIndex;
+    const uint32_t materialIndex;
 
 public:
     Shape();
-    Shape(const Color& color_, float reflectivity_, float transparency_, float refractiveIndex_);
+    Shape(const Color& color, float reflectivity, float transparency, float refractiveIndex);
+    Shape(uint32_t materialIndex_);
 
+    uint32_t getMaterialIndex(void) const;
+    const Material& getMaterial(void) const;
     float getTransparency(void) const;
     float getReflectivity(void) const;
     float getRefractiveIndex(void) const;
     const Color& getColor(void) const;
 
-    virtual bool intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const = 0;
+    // Finds the closest intersection in (0, far) and overwrites the hit with it
+    // Callers shrink far to hit->t after each hit, so that only closer intersections are recorded afterwards
+    virtual bool intersect(Hit* hit, const Ray& ray, float far) const = 0;
+
+    // Computes the hit location and the normal which faces the ray for a hit that intersect of this shape recorded
+    virtual Intersect getIntersect(const Hit& hit, const Ray& ray) const = 0;
+
+    // Finds the closest intersections of the rays of the packet, the ray i is tested in (0, fars[i])
+    // Overwrites hits[i] and shortens fars[i] to its distance for each ray that hits the shape
+    // The shape is skipped if the frustum of the packet misses its box, otherwise the rays are tested one by one
+    virtual void intersectPacket(Hit* hits, float* fars, const RayPacket& packet) const;
+
+    // Any-hit query for shadow rays, finds a shape which blocks the ray in (0, far) without the intersection details
+    virtual bool occluded(Shape** occludingShape, const Ray& ray, float far) const = 0;
     virtual void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const = 0;
 };
 
+// Tests the rays of the packet one by one against a shape if the frustum of the packet overlaps its box
+// The calls are resolved at compile time when the type of the shape is final
+template <typename ShapeType>
+void intersectPacketRays(const ShapeType& shape, Hit* hits, float* fars, const RayPacket& packet) {
+    Vector3D minPoint;
+    Vector3D maxPoint;
+    shape.findAABBMinMaxPoints(minPoint, maxPoint);
+    if (!frustumOverlapsAABB(packet.frustum, minPoint, maxPoint)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < RAY_PACKET_SIZE; i++) {
+        if (fars[i] > 0.0f && shape.intersect(hits + i, getRayPacketRay(packet, i), fars[i])) {
+            fars[i] = hits[i].t;
+        }
+    }
+}
+
 #endif // __SHAPE_H__
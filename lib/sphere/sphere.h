@@ -4,17 +4,67 @@
 
 #include <shape.h>
 
-class Sphere : public Shape {
+class Sphere final : public Shape {
 private:
     const Vector3D center;
     const float radius;
 
+    bool findT(const Ray& ray, float far, float& t) const;
+
 public:
     Sphere();
     Sphere(const Vector3D& center_, float radius_, const Color& color, float reflectivity, float transparency, float refractiveIndex);
 
-    bool intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const override;
+    bool intersect(Hit* hit, const Ray& ray, float far) const override;
+    Intersect getIntersect(const Hit& hit, const Ray& ray) const override;
+    bool occluded(Shape** occludingShape, const Ray& ray, float far) const override;
     void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const override;
 };
 
+// The intersection kernels are defined in the header, so that meshes can inline them into their traversal
+
+// Finds the distance to the closest intersection point in (0, far) if the ray intersects the sphere
+inline bool Sphere::findT(const Ray& ray, float far, float& t) const {
+    const Vector3D centerToOrigin = ray.origin - center;
+    const float dotProduct = centerToOrigin.dot(ray.dir);
+    const float quarterDiscriminant = dotProduct*dotProduct - centerToOrigin.magSquare() + radius*radius;
+    if (quarterDiscriminant <= EPSILON6) { // ray does not intersect the sphere
+        return false;
+    }
+
+    const float sqrtQuarterDiscriminant = sqrtf(quarterDiscriminant);
+    t = -dotProduct - sqrtQuarterDiscriminant; // Choose the closer intersection first
+    
+    if (t >= far) { // Check whether the ray is in the allowed range
+        return false;
+    } else if (t <= EPSILON6) {
+        t = -dotProduct + sqrtQuarterDiscriminant; // Choose the further intersection 
+        if (t >= far || t <= EPSILON6) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks whether the ray intersects the sphere and records the hit
+inline bool Sphere::intersect(Hit* hit, const Ray& ray, float far) const {
+    float t;
+    if (!findT(ray, far, t)) {
+        return false;
+    }
+
+    *hit = Hit{.t = t, .shape = this, .primitiveIndex = 0};
+    return true;
+}
+
+inline bool Sphere::occluded(Shape** occludingShape, const Ray& ray, float far) const {
+    float t;
+    if (!findT(ray, far, t)) {
+        return false;
+    }
+
+    *occludingShape = (Shape*)this;
+    return true;
+}
+
 #endif // __SPHERE_H__
@@ -7,44 +7,49 @@ Triangle::Triangle(const Vector3D& a, const Vector3D& b, const Vector3D& c,
     const Color& color, float reflectivity, float transparency, float refractiveIndex) 
     : Shape(color, reflectivity, transparency, refractiveIndex) {
     
-    points[0] = a;
-    points[1] = b;
-    points[2] = c;
-    normal = (b-a).cross(c-a).normalize();
+    vertex = a;
+    edge1 = b - a;
+    edge2 = c - a;
+    normal = edge1.cross(edge2).normalize();
 }
 
-// Checks whether the ray intersects the triangle and finds the intersection details
-bool Triangle::intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const {
-    // Check whether the ray direction is parallel to the triangle
-    if (abs(normal.dot(ray.dir)) < EPSILON6) {
-        return false;
-    }
+// Triangles of a tessellated surface share the material of the surface
+Triangle::Triangle(const Vector3D& a, const Vector3D& b, const Vector3D& c, uint32_t materialIndex) : Shape(materialIndex) {
+    vertex = a;
+    edge1 = b - a;
+    edge2 = c - a;
+    normal = edge1.cross(edge2).normalize();
+}
 
-    // Solve for Beta, Gamma, and t 
-    Matrix3x3 matrix = Matrix3x3(points[0]-points[1], points[0]-points[2], ray.dir, true);
-    Vector3D vector = points[0] - ray.origin;
-    const Vector3D result = Matrix3x3::solve(matrix, vector);
+const Vector3D& Triangle::getVertex(void) const {
+    return vertex;
+}
 
-    // If Beta > 0 and Gamma > 0, Beta + Gamma < 1, and 0 < t < far, the ray intersects the triangle
-    if (result.x > EPSILON6 && result.y > EPSILON6 && result.x + result.y < 1.0f && result.z > EPSILON6 && result.z < far) {
-        if (intersectedShape != NULL) {
-            *intersectedShape = (Shape*)this;
-        }
-        if (intersect != NULL) {
-            intersect->t = result.z;
-            intersect->hitLocation = ray.origin + ray.dir * intersect->t;
-            intersect->normal = normal;
-            if (ray.dir.dot(normal) > 0.0f) {
-                intersect->normal *= -1.0f;
-            }
-        }
-        return true;
-    } else { // ray does not intersect the triangle
-        return false;
+const Vector3D& Triangle::getEdge1(void) const {
+    return edge1;
+}
+
+const Vector3D& Triangle::getEdge2(void) const {
+    return edge2;
+}
+
+const Vector3D& Triangle::getNormal(void) const {
+    return normal;
+}
+
+Intersect Triangle::getIntersect(const Hit& hit, const Ray& ray) const {
+    Intersect intersect;
+    intersect.t = hit.t;
+    intersect.hitLocation = ray.origin + ray.dir * hit.t;
+    intersect.normal = normal;
+    if (ray.dir.dot(normal) > 0.0f) {
+        intersect.normal *= -1.0f;
     }
+    return intersect;
 }
 
 void Triangle::findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const {
+    const Vector3D points[3] = {vertex, vertex + edge1, vertex + edge2};
     minPoint = Vector3D(INFINITY);
     maxPoint = Vector3D(-INFINITY);
 
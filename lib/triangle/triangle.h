@@ -3,19 +3,90 @@
 #define __TRIANGLE_H__
 
 #include <shape.h>
-#include <matrix3x3.h>
+#include <aligned_vector3d.h>
 
-class Triangle : public Shape {
+class Triangle final : public Shape {
 private:
-    Vector3D points[3];
-    Vector3D normal;
+    AlignedVector3D vertex;
+    AlignedVector3D edge1; // From the first vertex to the second one
+    AlignedVector3D edge2; // From the first vertex to the third one
+    AlignedVector3D normal;
+
+    bool findT(const Ray& ray, float far, float& t, float& beta, float& gamma) const;
 
 public:
     Triangle();
     Triangle(const Vector3D& a, const Vector3D& b, const Vector3D& c, const Color& color, float reflectivity, float transparency, float refractiveIndex);
+    Triangle(const Vector3D& a, const Vector3D& b, const Vector3D& c, uint32_t materialIndex);
+
+    const Vector3D& getVertex(void) const;
+    const Vector3D& getEdge1(void) const;
+    const Vector3D& getEdge2(void) const;
+    const Vector3D& getNormal(void) const;
     
-    bool intersect(Intersect* intersect, Shape** intersectedShape, const Ray& ray, float far) const override;
+    bool intersect(Hit* hit, const Ray& ray, float far) const override;
+    Intersect getIntersect(const Hit& hit, const Ray& ray) const override;
+    bool occluded(Shape** occludingShape, const Ray& ray, float far) const override;
     void findAABBMinMaxPoints(Vector3D& minPoint, Vector3D& maxPoint) const override;
 };
 
+// The intersection kernels are defined in the header, so that meshes can inline them into their traversal
+
+// Finds the distance to the intersection point if the ray intersects the triangle in (0, far)
+// Solves origin + t*dir = vertex + Beta*edge1 + Gamma*edge2 with the Moller-Trumbore algorithm
+inline bool Triangle::findT(const Ray& ray, float far, float& t, float& beta, float& gamma) const {
+    // Load the ray into SSE registers once, the triangle is already stored aligned
+    const AlignedVector3D dir = ray.dir;
+    const AlignedVector3D origin = ray.origin;
+
+    // Check whether the ray direction is parallel to the triangle
+    if (abs(normal.dot(dir)) < EPSILON6) {
+        return false;
+    }
+
+    const AlignedVector3D dirCrossEdge2 = dir.cross(edge2);
+    const float inverseDeterminant = 1.0f / edge1.dot(dirCrossEdge2);
+    const AlignedVector3D vertexToOrigin = origin - vertex;
+
+    beta = vertexToOrigin.dot(dirCrossEdge2) * inverseDeterminant;
+    if (beta <= EPSILON6 || beta >= 1.0f) {
+        return false;
+    }
+
+    const AlignedVector3D vertexToOriginCrossEdge1 = vertexToOrigin.cross(edge1);
+    gamma = dir.dot(vertexToOriginCrossEdge1) * inverseDeterminant;
+    if (gamma <= EPSILON6 || beta + gamma >= 1.0f) {
+        return false;
+    }
+
+    // If Beta > 0 and Gamma > 0, Beta + Gamma < 1, and 0 < t < far, the ray intersects the triangle
+    t = edge2.dot(vertexToOriginCrossEdge1) * inverseDeterminant;
+    return t > EPSILON6 && t < far;
+}
+
+// Checks whether the ray intersects the triangle and records the hit
+inline bool Triangle::intersect(Hit* hit, const Ray& ray, float far) const {
+    float t;
+    float beta;
+    float gamma;
+    if (!findT(ray, far, t, beta, gamma)) {
+        return false;
+    }
+
+    *hit = Hit{.t = t, .shape = this, .primitiveIndex = 0, .beta = beta, .gamma = gamma};
+    return true;
+}
+
+inline bool Triangle::occluded(Shape** occludingShape, const Ray& ray, float far) const {
+    float t;
+    float beta;
+    float gamma;
+    if (!findT(ray, far, t, beta, gamma)) {
+        return false;
+    }
+
+    *occludingShape = (Shape*)this;
+    return true;
+}
+
 #endif // __TRIANGLE_H__
@@ -0,0 +1,535 @@
+
+#include "triangle_block.h"
+
+#ifdef CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
+void setTriangleBlockLane(TriangleBlock& block, uint32_t lane, const Vector3D& vertex, const Vector3D& edge1, 
+    const Vector3D& edge2, const Vector3D& normal) {
+    assert(lane < TRIANGLE_BLOCK_SIZE);
+
+    block.vertexX[lane] = vertex.x;
+    block.vertexY[lane] = vertex.y;
+    block.vertexZ[lane] = vertex.z;
+    block.edge1X[lane] = edge1.x;
+    block.edge1Y[lane] = edge1.y;
+    block.edge1Z[lane] = edge1.z;
+    block.edge2X[lane] = edge2.x;
+    block.edge2Y[lane] = edge2.y;
+    block.edge2Z[lane] = edge2.z;
+    block.normalX[lane] = normal.x;
+    block.normalY[lane] = normal.y;
+    block.normalZ[lane] = normal.z;
+}
+
+Vector3D getTriangleBlockNormal(const TriangleBlock& block, uint32_t lane) {
+    assert(lane < TRIANGLE_BLOCK_SIZE);
+    return Vector3D(block.normalX[lane], block.normalY[lane], block.normalZ[lane]);
+}
+
+// Sets every lane to the triangle of its three vertices, whose coordinates are given per vertex and lane
+// The lanes are independent, so the compiler vectorizes the loop, degenerate triangles get zero normals
+static inline void setTriangleBlockVertices(TriangleBlock& block, const float xs[3][TRIANGLE_BLOCK_SIZE], 
+    const float ys[3][TRIANGLE_BLOCK_SIZE], const float zs[3][TRIANGLE_BLOCK_SIZE]) {
+    for (uint32_t lane = 0; lane < TRIANGLE_BLOCK_SIZE; lane++) {
+        const float edge1X = xs[1][lane] - xs[0][lane];
+        const float edge1Y = ys[1][lane] - ys[0][lane];
+        const float edge1Z = zs[1][lane] - zs[0][lane];
+        const float edge2X = xs[2][lane] - xs[0][lane];
+        const float edge2Y = ys[2][lane] - ys[0][lane];
+        const float edge2Z = zs[2][lane] - zs[0][lane];
+        const float normalX = edge1Y*edge2Z - edge1Z*edge2Y;
+        const float normalY = edge1Z*edge2X - edge1X*edge2Z;
+        const float normalZ = edge1X*edge2Y - edge1Y*edge2X;
+        const float normalMagnitudeSquare = normalX*normalX + normalY*normalY + normalZ*normalZ;
+        const float inverseMagnitude = (normalMagnitudeSquare > 0.0f) ? 1.0f / sqrtf(normalMagnitudeSquare) : 0.0f;
+
+        block.vertexX[lane] = xs[0][lane];
+        block.vertexY[lane] = ys[0][lane];
+        block.vertexZ[lane] = zs[0][lane];
+        block.edge1X[lane] = edge1X;
+        block.edge1Y[lane] = edge1Y;
+        block.edge1Z[lane] = edge1Z;
+        block.edge2X[lane] = edge2X;
+        block.edge2Y[lane] = edge2Y;
+        block.edge2Z[lane] = edge2Z;
+        block.normalX[lane] = normalX * inverseMagnitude;
+        block.normalY[lane] = normalY * inverseMagnitude;
+        block.normalZ[lane] = normalZ * inverseMagnitude;
+    }
+}
+
+void gatherTriangleBlock(const Vector3D* vertices, const uint16_t* indices, TriangleBlock& block) {
+    float xs[3][TRIANGLE_BLOCK_SIZE];
+    float ys[3][TRIANGLE_BLOCK_SIZE];
+    float zs[3][TRIANGLE_BLOCK_SIZE];
+    for (uint32_t lane = 0; lane < TRIANGLE_BLOCK_SIZE; lane++) {
+        for (uint32_t i = 0; i < 3; i++) {
+            const Vector3D& vertex = vertices[indices[3*lane+i]];
+            xs[i][lane] = vertex.x;
+            ys[i][lane] = vertex.y;
+            zs[i][lane] = vertex.z;
+        }
+    }
+    setTriangleBlockVertices(block, xs, ys, zs);
+}
+
+void gatherQuantizedTriangleBlock(const uint16_t* coordinates, const Vector3D& origin, float step, const uint16_t* indices, 
+    TriangleBlock& block) {
+    float xs[3][TRIANGLE_BLOCK_SIZE];
+    float ys[3][TRIANGLE_BLOCK_SIZE];
+    float zs[3][TRIANGLE_BLOCK_SIZE];
+    for (uint32_t lane = 0; lane < TRIANGLE_BLOCK_SIZE; lane++) {
+        for (uint32_t i = 0; i < 3; i++) {
+            const uint16_t* vertex = coordinates + 3*indices[3*lane+i];
+            xs[i][lane] = origin.x + step * vertex[0];
+            ys[i][lane] = origin.y + step * vertex[1];
+            zs[i][lane] = origin.z + step * vertex[2];
+        }
+    }
+    setTriangleBlockVertices(block, xs, ys, zs);
+}
+
+#ifdef CPU_DISPATCH
+
+// Moller-Trumbore test of the two halves of the block with 4 lanes each
+__attribute__((target("sse4.2")))
+static int32_t intersectTriangleBlockSSE42(const TriangleBlock& block, const Ray& ray, float far, float& t, float& beta, float& gamma) {
+    const __m128 dirX = _mm_set1_ps(ray.dir.x);
+    const __m128 dirY = _mm_set1_ps(ray.dir.y);
+    const __m128 dirZ = _mm_set1_ps(ray.dir.z);
+    const __m128 epsilon = _mm_set1_ps(EPSILON6);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    alignas(16) float ts[TRIANGLE_BLOCK_SIZE];
+    alignas(16) float betas[TRIANGLE_BLOCK_SIZE];
+    alignas(16) float gammas[TRIANGLE_BLOCK_SIZE];
+    uint32_t validMask = 0;
+
+    for (uint32_t i = 0; i < TRIANGLE_BLOCK_SIZE; i += 4) {
+        const __m128 edge1X = _mm_load_ps(block.edge1X + i);
+        const __m128 edge1Y = _mm_load_ps(block.edge1Y + i);
+        const __m128 edge1Z = _mm_load_ps(block.edge1Z + i);
+        const __m128 edge2X = _mm_load_ps(block.edge2X + i);
+        const __m128 edge2Y = _mm_load_ps(block.edge2Y + i);
+        const __m128 edge2Z = _mm_load_ps(block.edge2Z + i);
+
+        // Discard the triangles which are parallel to the ray
+        const __m128 normalDotDir = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_load_ps(block.normalX + i), dirX), 
+            _mm_mul_ps(_mm_load_ps(block.normalY + i), dirY)), 
+            _mm_mul_ps(_mm_load_ps(block.normalZ + i), dirZ));
+        __m128 valid = _mm_cmpge_ps(_mm_andnot_ps(signMask, normalDotDir), epsilon);
+
+        const __m128 dirCrossEdge2X = _mm_sub_ps(_mm_mul_ps(dirY, edge2Z), _mm_mul_ps(dirZ, edge2Y));
+        const __m128 dirCrossEdge2Y = _mm_sub_ps(_mm_mul_ps(dirZ, edge2X), _mm_mul_ps(dirX, edge2Z));
+        const __m128 dirCrossEdge2Z = _mm_sub_ps(_mm_mul_ps(dirX, edge2Y), _mm_mul_ps(dirY, edge2X));
+        const __m128 determinant = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(edge1X, dirCrossEdge2X), 
+            _mm_mul_ps(edge1Y, dirCrossEdge2Y)), 
+            _mm_mul_ps(edge1Z, dirCrossEdge2Z));
+        const __m128 inverseDeterminant = _mm_div_ps(one, _mm_blendv_ps(one, determinant, valid));
+
+        const __m128 vertexToOriginX = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.vertexX + i));
+        const __m128 vertexToOriginY = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.vertexY + i));
+        const __m128 vertexToOriginZ = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.vertexZ + i));
+
+        const __m128 laneBetas = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(vertexToOriginX, dirCrossEdge2X), 
+            _mm_mul_ps(vertexToOriginY, dirCrossEdge2Y)), 
+            _mm_mul_ps(vertexToOriginZ, dirCrossEdge2Z)), inverseDeterminant);
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(laneBetas, epsilon), _mm_cmplt_ps(laneBetas, one)));
+
+        const __m128 crossX = _mm_sub_ps(_mm_mul_ps(vertexToOriginY, edge1Z), _mm_mul_ps(vertexToOriginZ, edge1Y));
+        const __m128 crossY = _mm_sub_ps(_mm_mul_ps(vertexToOriginZ, edge1X), _mm_mul_ps(vertexToOriginX, edge1Z));
+        const __m128 crossZ = _mm_sub_ps(_mm_mul_ps(vertexToOriginX, edge1Y), _mm_mul_ps(vertexToOriginY, edge1X));
+
+        const __m128 laneGammas = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(dirX, crossX), 
+            _mm_mul_ps(dirY, crossY)), 
+            _mm_mul_ps(dirZ, crossZ)), inverseDeterminant);
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(laneGammas, epsilon));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(_mm_add_ps(laneBetas, laneGammas), one));
+
+        const __m128 laneTs = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(edge2X, crossX), 
+            _mm_mul_ps(edge2Y, crossY)), 
+            _mm_mul_ps(edge2Z, crossZ)), inverseDeterminant);
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(laneTs, epsilon), _mm_cmplt_ps(laneTs, _mm_set1_ps(far))));
+
+        _mm_store_ps(ts + i, laneTs);
+        _mm_store_ps(betas + i, laneBetas);
+        _mm_store_ps(gammas + i, laneGammas);
+        validMask |= _mm_movemask_ps(valid) << i;
+    }
+
+    // Find the first lane with the smallest t among the hits
+    int32_t closestLane = -1;
+    while (validMask != 0) {
+        const uint32_t lane = __builtin_ctz(validMask);
+        validMask &= validMask - 1;
+        if (closestLane < 0 || ts[lane] < ts[closestLane]) {
+            closestLane = lane;
+        }
+    }
+
+    if (closestLane >= 0) {
+        t = ts[closestLane];
+        beta = betas[closestLane];
+        gamma = gammas[closestLane];
+    }
+    return closestLane;
+}
+
+// Moller-Trumbore test of 8 triangles at once, with the same bounds as Triangle::intersect
+__attribute__((target("avx2,fma")))
+static int32_t intersectTriangleBlockAVX2(const TriangleBlock& block, const Ray& ray, float far, float& t, float& beta, float& gamma) {
+    const __m256 dirX = _mm256_set1_ps(ray.dir.x);
+    const __m256 dirY = _mm256_set1_ps(ray.dir.y);
+    const __m256 dirZ = _mm256_set1_ps(ray.dir.z);
+    const __m256 epsilon = _mm256_set1_ps(EPSILON6);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    const __m256 edge1X = _mm256_load_ps(block.edge1X);
+    const __m256 edge1Y = _mm256_load_ps(block.edge1Y);
+    const __m256 edge1Z = _mm256_load_ps(block.edge1Z);
+    const __m256 edge2X = _mm256_load_ps(block.edge2X);
+    const __m256 edge2Y = _mm256_load_ps(block.edge2Y);
+    const __m256 edge2Z = _mm256_load_ps(block.edge2Z);
+
+    // Discard the triangles which are parallel to the ray
+    const __m256 normalDotDir = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_load_ps(block.normalX), dirX), 
+        _mm256_mul_ps(_mm256_load_ps(block.normalY), dirY)), 
+        _mm256_mul_ps(_mm256_load_ps(block.normalZ), dirZ));
+    __m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(signMask, normalDotDir), epsilon, _CMP_GE_OQ);
+
+    const __m256 dirCrossEdge2X = _mm256_sub_ps(_mm256_mul_ps(dirY, edge2Z), _mm256_mul_ps(dirZ, edge2Y));
+    const __m256 dirCrossEdge2Y = _mm256_sub_ps(_mm256_mul_ps(dirZ, edge2X), _mm256_mul_ps(dirX, edge2Z));
+    const __m256 dirCrossEdge2Z = _mm256_sub_ps(_mm256_mul_ps(dirX, edge2Y), _mm256_mul_ps(dirY, edge2X));
+    const __m256 determinant = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(edge1X, dirCrossEdge2X), 
+        _mm256_mul_ps(edge1Y, dirCrossEdge2Y)), 
+        _mm256_mul_ps(edge1Z, dirCrossEdge2Z));
+    const __m256 inverseDeterminant = _mm256_div_ps(one, _mm256_blendv_ps(one, determinant, valid));
+
+    const __m256 vertexToOriginX = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(block.vertexX));
+    const __m256 vertexToOriginY = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(block.vertexY));
+    const __m256 vertexToOriginZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(block.vertexZ));
+
+    const __m256 betas = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(vertexToOriginX, dirCrossEdge2X), 
+        _mm256_mul_ps(vertexToOriginY, dirCrossEdge2Y)), 
+        _mm256_mul_ps(vertexToOriginZ, dirCrossEdge2Z)), inverseDeterminant);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(betas, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(betas, one, _CMP_LT_OQ));
+
+    const __m256 crossX = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginY, edge1Z), _mm256_mul_ps(vertexToOriginZ, edge1Y));
+    const __m256 crossY = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginZ, edge1X), _mm256_mul_ps(vertexToOriginX, edge1Z));
+    const __m256 crossZ = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginX, edge1Y), _mm256_mul_ps(vertexToOriginY, edge1X));
+
+    const __m256 gammas = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(dirX, crossX), 
+        _mm256_mul_ps(dirY, crossY)), 
+        _mm256_mul_ps(dirZ, crossZ)), inverseDeterminant);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(gammas, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(betas, gammas), one, _CMP_LT_OQ));
+
+    const __m256 ts = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(edge2X, crossX), 
+        _mm256_mul_ps(edge2Y, crossY)), 
+        _mm256_mul_ps(edge2Z, crossZ)), inverseDeterminant);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(ts, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(ts, _mm256_set1_ps(far), _CMP_LT_OQ));
+
+    const int validMask = _mm256_movemask_ps(valid);
+    if (validMask == 0) {
+        return -1;
+    }
+
+    // Find the smallest t among the hits and the first lane which has it
+    const __m256 hitTs = _mm256_blendv_ps(_mm256_set1_ps(far), ts, valid);
+    __m256 minT = _mm256_min_ps(hitTs, _mm256_permute2f128_ps(hitTs, hitTs, 1));
+    minT = _mm256_min_ps(minT, _mm256_shuffle_ps(minT, minT, _MM_SHUFFLE(1, 0, 3, 2)));
+    minT = _mm256_min_ps(minT, _mm256_shuffle_ps(minT, minT, _MM_SHUFFLE(2, 3, 0, 1)));
+    const int closestMask = _mm256_movemask_ps(_mm256_cmp_ps(hitTs, minT, _CMP_EQ_OQ)) & validMask;
+
+    const int32_t closestLane = __builtin_ctz(closestMask);
+    float laneBetas[TRIANGLE_BLOCK_SIZE];
+    float laneGammas[TRIANGLE_BLOCK_SIZE];
+    _mm256_storeu_ps(laneBetas, betas);
+    _mm256_storeu_ps(laneGammas, gammas);
+
+    t = _mm256_cvtss_f32(minT);
+    beta = laneBetas[closestLane];
+    gamma = laneGammas[closestLane];
+    return closestLane;
+}
+
+// Same test as the AVX2 variant, the conditions are kept in mask registers instead of vectors
+// The blocks without a valid lane return early, and the closest lane is compressed out of the registers instead of the stack
+__attribute__((target("avx512f,avx512vl,avx2,fma")))
+static int32_t intersectTriangleBlockAVX512(const TriangleBlock& block, const Ray& ray, float far, float& t, float& beta, float& gamma) {
+    const __m256 dirX = _mm256_set1_ps(ray.dir.x);
+    const __m256 dirY = _mm256_set1_ps(ray.dir.y);
+    const __m256 dirZ = _mm256_set1_ps(ray.dir.z);
+    const __m256 epsilon = _mm256_set1_ps(EPSILON6);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 farVector = _mm256_set1_ps(far);
+
+    const __m256 edge1X = _mm256_load_ps(block.edge1X);
+    const __m256 edge1Y = _mm256_load_ps(block.edge1Y);
+    const __m256 edge1Z = _mm256_load_ps(block.edge1Z);
+    const __m256 edge2X = _mm256_load_ps(block.edge2X);
+    const __m256 edge2Y = _mm256_load_ps(block.edge2Y);
+    const __m256 edge2Z = _mm256_load_ps(block.edge2Z);
+
+    // Discard the triangles which are parallel to the ray
+    const __m256 normalDotDir = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_load_ps(block.normalX), dirX), 
+        _mm256_mul_ps(_mm256_load_ps(block.normalY), dirY)), 
+        _mm256_mul_ps(_mm256_load_ps(block.normalZ), dirZ));
+    __mmask8 valid = _mm256_cmp_ps_mask(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), normalDotDir), epsilon, _CMP_GE_OQ);
+    if (valid == 0) {
+        return -1;
+    }
+
+    const __m256 dirCrossEdge2X = _mm256_sub_ps(_mm256_mul_ps(dirY, edge2Z), _mm256_mul_ps(dirZ, edge2Y));
+    const __m256 dirCrossEdge2Y = _mm256_sub_ps(_mm256_mul_ps(dirZ, edge2X), _mm256_mul_ps(dirX, edge2Z));
+    const __m256 dirCrossEdge2Z = _mm256_sub_ps(_mm256_mul_ps(dirX, edge2Y), _mm256_mul_ps(dirY, edge2X));
+    const __m256 determinant = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(edge1X, dirCrossEdge2X), 
+        _mm256_mul_ps(edge1Y, dirCrossEdge2Y)), 
+        _mm256_mul_ps(edge1Z, dirCrossEdge2Z));
+    const __m256 inverseDeterminant = _mm256_div_ps(one, _mm256_mask_blend_ps(valid, one, determinant));
+
+    const __m256 vertexToOriginX = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(block.vertexX));
+    const __m256 vertexToOriginY = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(block.vertexY));
+    const __m256 vertexToOriginZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(block.vertexZ));
+
+    const __m256 betas = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(vertexToOriginX, dirCrossEdge2X), 
+        _mm256_mul_ps(vertexToOriginY, dirCrossEdge2Y)), 
+        _mm256_mul_ps(vertexToOriginZ, dirCrossEdge2Z)), inverseDeterminant);
+    valid = _mm256_mask_cmp_ps_mask(valid, betas, epsilon, _CMP_GT_OQ);
+    valid = _mm256_mask_cmp_ps_mask(valid, betas, one, _CMP_LT_OQ);
+
+    const __m256 crossX = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginY, edge1Z), _mm256_mul_ps(vertexToOriginZ, edge1Y));
+    const __m256 crossY = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginZ, edge1X), _mm256_mul_ps(vertexToOriginX, edge1Z));
+    const __m256 crossZ = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginX, edge1Y), _mm256_mul_ps(vertexToOriginY, edge1X));
+
+    const __m256 gammas = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(dirX, crossX), 
+        _mm256_mul_ps(dirY, crossY)), 
+        _mm256_mul_ps(dirZ, crossZ)), inverseDeterminant);
+    valid = _mm256_mask_cmp_ps_mask(valid, gammas, epsilon, _CMP_GT_OQ);
+    valid = _mm256_mask_cmp_ps_mask(valid, _mm256_add_ps(betas, gammas), one, _CMP_LT_OQ);
+
+    const __m256 ts = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(edge2X, crossX), 
+        _mm256_mul_ps(edge2Y, crossY)), 
+        _mm256_mul_ps(edge2Z, crossZ)), inverseDeterminant);
+    valid = _mm256_mask_cmp_ps_mask(valid, ts, epsilon, _CMP_GT_OQ);
+    valid = _mm256_mask_cmp_ps_mask(valid, ts, farVector, _CMP_LT_OQ);
+    if (valid == 0) {
+        return -1;
+    }
+
+    // Find the smallest t among the hits and the first lane which has it
+    const __m256 hitTs = _mm256_mask_blend_ps(valid, farVector, ts);
+    __m256 minT = _mm256_min_ps(hitTs, _mm256_permute2f128_ps(hitTs, hitTs, 1));
+    minT = _mm256_min_ps(minT, _mm256_shuffle_ps(minT, minT, _MM_SHUFFLE(1, 0, 3, 2)));
+    minT = _mm256_min_ps(minT, _mm256_shuffle_ps(minT, minT, _MM_SHUFFLE(2, 3, 0, 1)));
+    const __mmask8 closestMask = _mm256_mask_cmp_ps_mask(valid, hitTs, minT, _CMP_EQ_OQ);
+    const int32_t closestLane = __builtin_ctz(closestMask);
+    const __mmask8 closestLaneMask = 1 << closestLane;
+
+    t = _mm256_cvtss_f32(minT);
+    beta = _mm256_cvtss_f32(_mm256_maskz_compress_ps(closestLaneMask, betas));
+    gamma = _mm256_cvtss_f32(_mm256_maskz_compress_ps(closestLaneMask, gammas));
+    return closestLane;
+}
+
+// Moller-Trumbore test of 8 rays against a triangle at once
+// The AVX-512 path uses this variant as well, and the SSE4.2 path uses the scalar one
+__attribute__((target("avx2,fma")))
+static uint32_t intersectRayBlockAVX2(const RayBlock& rays, const TriangleBlock& block, uint32_t lane, float* fars, float* betas, float* gammas) {
+    const __m256 dirX = _mm256_load_ps(rays.dirX);
+    const __m256 dirY = _mm256_load_ps(rays.dirY);
+    const __m256 dirZ = _mm256_load_ps(rays.dirZ);
+    const __m256 epsilon = _mm256_set1_ps(EPSILON6);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    const __m256 edge1X = _mm256_set1_ps(block.edge1X[lane]);
+    const __m256 edge1Y = _mm256_set1_ps(block.edge1Y[lane]);
+    const __m256 edge1Z = _mm256_set1_ps(block.edge1Z[lane]);
+    const __m256 edge2X = _mm256_set1_ps(block.edge2X[lane]);
+    const __m256 edge2Y = _mm256_set1_ps(block.edge2Y[lane]);
+    const __m256 edge2Z = _mm256_set1_ps(block.edge2Z[lane]);
+
+    // Discard the rays which are parallel to the triangle
+    const __m256 normalDotDir = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_set1_ps(block.normalX[lane]), dirX), 
+        _mm256_mul_ps(_mm256_set1_ps(block.normalY[lane]), dirY)), 
+        _mm256_mul_ps(_mm256_set1_ps(block.normalZ[lane]), dirZ));
+    __m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(signMask, normalDotDir), epsilon, _CMP_GE_OQ);
+
+    const __m256 dirCrossEdge2X = _mm256_sub_ps(_mm256_mul_ps(dirY, edge2Z), _mm256_mul_ps(dirZ, edge2Y));
+    const __m256 dirCrossEdge2Y = _mm256_sub_ps(_mm256_mul_ps(dirZ, edge2X), _mm256_mul_ps(dirX, edge2Z));
+    const __m256 dirCrossEdge2Z = _mm256_sub_ps(_mm256_mul_ps(dirX, edge2Y), _mm256_mul_ps(dirY, edge2X));
+    const __m256 determinant = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(edge1X, dirCrossEdge2X), 
+        _mm256_mul_ps(edge1Y, dirCrossEdge2Y)), 
+        _mm256_mul_ps(edge1Z, dirCrossEdge2Z));
+    const __m256 inverseDeterminant = _mm256_div_ps(one, _mm256_blendv_ps(one, determinant, valid));
+
+    const __m256 vertexToOriginX = _mm256_sub_ps(_mm256_load_ps(rays.originX), _mm256_set1_ps(block.vertexX[lane]));
+    const __m256 vertexToOriginY = _mm256_sub_ps(_mm256_load_ps(rays.originY), _mm256_set1_ps(block.vertexY[lane]));
+    const __m256 vertexToOriginZ = _mm256_sub_ps(_mm256_load_ps(rays.originZ), _mm256_set1_ps(block.vertexZ[lane]));
+
+    const __m256 rayBetas = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(vertexToOriginX, dirCrossEdge2X), 
+        _mm256_mul_ps(vertexToOriginY, dirCrossEdge2Y)), 
+        _mm256_mul_ps(vertexToOriginZ, dirCrossEdge2Z)), inverseDeterminant);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(rayBetas, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(rayBetas, one, _CMP_LT_OQ));
+
+    const __m256 crossX = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginY, edge1Z), _mm256_mul_ps(vertexToOriginZ, edge1Y));
+    const __m256 crossY = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginZ, edge1X), _mm256_mul_ps(vertexToOriginX, edge1Z));
+    const __m256 crossZ = _mm256_sub_ps(_mm256_mul_ps(vertexToOriginX, edge1Y), _mm256_mul_ps(vertexToOriginY, edge1X));
+
+    const __m256 rayGammas = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(dirX, crossX), 
+        _mm256_mul_ps(dirY, crossY)), 
+        _mm256_mul_ps(dirZ, crossZ)), inverseDeterminant);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(rayGammas, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(rayBetas, rayGammas), one, _CMP_LT_OQ));
+
+    const __m256 rayFars = _mm256_loadu_ps(fars);
+    const __m256 ts = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(edge2X, crossX), 
+        _mm256_mul_ps(edge2Y, crossY)), 
+        _mm256_mul_ps(edge2Z, crossZ)), inverseDeterminant);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(ts, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(ts, rayFars, _CMP_LT_OQ));
+
+    const uint32_t hitMask = _mm256_movemask_ps(valid);
+    if (hitMask != 0) {
+        _mm256_storeu_ps(fars, _mm256_blendv_ps(rayFars, ts, valid));
+        _mm256_storeu_ps(betas, _mm256_blendv_ps(_mm256_loadu_ps(betas), rayBetas, valid));
+        _mm256_storeu_ps(gammas, _mm256_blendv_ps(_mm256_loadu_ps(gammas), rayGammas, valid));
+    }
+    return hitMask;
+}
+
+#endif // CPU_DISPATCH
+
+// Moller-Trumbore test of the triangles one by one, with the same bounds as Triangle::intersect
+static int32_t intersectTriangleBlockScalar(const TriangleBlock& block, const Ray& ray, float far, float& t, float& beta, float& gamma) {
+    int32_t closestLane = -1;
+
+    for (uint32_t i = 0; i < TRIANGLE_BLOCK_SIZE; i++) {
+        const Vector3D edge1 = Vector3D(block.edge1X[i], block.edge1Y[i], block.edge1Z[i]);
+        const Vector3D edge2 = Vector3D(block.edge2X[i], block.edge2Y[i], block.edge2Z[i]);
+        if (abs(getTriangleBlockNormal(block, i).dot(ray.dir)) < EPSILON6) {
+            continue;
+        }
+
+        const Vector3D dirCrossEdge2 = ray.dir.cross(edge2);
+        const float inverseDeterminant = 1.0f / edge1.dot(dirCrossEdge2);
+        const Vector3D vertexToOrigin = ray.origin - Vector3D(block.vertexX[i], block.vertexY[i], block.vertexZ[i]);
+
+        const float laneBeta = vertexToOrigin.dot(dirCrossEdge2) * inverseDeterminant;
+        if (laneBeta <= EPSILON6 || laneBeta >= 1.0f) {
+            continue;
+        }
+
+        const Vector3D vertexToOriginCrossEdge1 = vertexToOrigin.cross(edge1);
+        const float laneGamma = ray.dir.dot(vertexToOriginCrossEdge1) * inverseDeterminant;
+        if (laneGamma <= EPSILON6 || laneBeta + laneGamma >= 1.0f) {
+            continue;
+        }
+
+        const float currentT = edge2.dot(vertexToOriginCrossEdge1) * inverseDeterminant;
+        if (currentT > EPSILON6 && currentT < far) {
+            far = currentT;
+            t = currentT;
+            beta = laneBeta;
+            gamma = laneGamma;
+            closestLane = i;
+        }
+    }
+
+    return closestLane;
+}
+
+int32_t intersectTriangleBlock(const TriangleBlock& block, const Ray& ray, float far, float& t, float& beta, float& gamma) {
+#ifdef CPU_DISPATCH
+    switch (getCPUPath()) {
+    case CPU_PATH_AVX512:
+        return intersectTriangleBlockAVX512(block, ray, far, t, beta, gamma);
+    case CPU_PATH_AVX2:
+        return intersectTriangleBlockAVX2(block, ray, far, t, beta, gamma);
+    case CPU_PATH_SSE42:
+        return intersectTriangleBlockSSE42(block, ray, far, t, beta, gamma);
+    default:
+        break;
+    }
+#endif
+    return intersectTriangleBlockScalar(block, ray, far, t, beta, gamma);
+}
+
+// Moller-Trumbore test of the rays one by one
+static uint32_t intersectRayBlockScalar(const RayBlock& rays, const TriangleBlock& block, uint32_t lane, float* fars, float* betas, float* gammas) {
+    const Vector3D vertex = Vector3D(block.vertexX[lane], block.vertexY[lane], block.vertexZ[lane]);
+    const Vector3D edge1 = Vector3D(block.edge1X[lane], block.edge1Y[lane], block.edge1Z[lane]);
+    const Vector3D edge2 = Vector3D(block.edge2X[lane], block.edge2Y[lane], block.edge2Z[lane]);
+    const Vector3D normal = getTriangleBlockNormal(block, lane);
+    uint32_t hitMask = 0;
+
+    for (uint32_t i = 0; i < RAY_BLOCK_SIZE; i++) {
+        const Ray ray = getRayBlockLane(rays, i);
+        if (abs(normal.dot(ray.dir)) < EPSILON6) {
+            continue;
+        }
+
+        const Vector3D dirCrossEdge2 = ray.dir.cross(edge2);
+        const float inverseDeterminant = 1.0f / edge1.dot(dirCrossEdge2);
+        const Vector3D vertexToOrigin = ray.origin - vertex;
+
+        const float rayBeta = vertexToOrigin.dot(dirCrossEdge2) * inverseDeterminant;
+        if (rayBeta <= EPSILON6 || rayBeta >= 1.0f) {
+            continue;
+        }
+
+        const Vector3D vertexToOriginCrossEdge1 = vertexToOrigin.cross(edge1);
+        const float rayGamma = ray.dir.dot(vertexToOriginCrossEdge1) * inverseDeterminant;
+        if (rayGamma <= EPSILON6 || rayBeta + rayGamma >= 1.0f) {
+            continue;
+        }
+
+        const float t = edge2.dot(vertexToOriginCrossEdge1) * inverseDeterminant;
+        if (t > EPSILON6 && t < fars[i]) {
+            fars[i] = t;
+            betas[i] = rayBeta;
+            gammas[i] = rayGamma;
+            hitMask |= 1 << i;
+        }
+    }
+
+    return hitMask;
+}
+
+uint32_t intersectRayBlock(const RayBlock& rays, const TriangleBlock& block, uint32_t lane, float* fars, float* betas, float* gammas) {
+    assert(lane < TRIANGLE_BLOCK_SIZE);
+#ifdef CPU_DISPATCH
+    if (getCPUPath() >= CPU_PATH_AVX2) {
+        return intersectRayBlockAVX2(rays, block, lane, fars, betas, gammas);
+    }
+#endif
+    return intersectRayBlockScalar(rays, block, lane, fars, betas, gammas);
+}
@@ -0,0 +1,51 @@
+
+#ifndef __TRIANGLE_BLOCK_H__
+#define __TRIANGLE_BLOCK_H__
+
+#include <stdint.h>
+#include <vector3d.h>
+#include <cpu.h>
+#include <ray_packet.h>
+
+#define TRIANGLE_BLOCK_SIZE 8
+
+// Triangles in structure-of-arrays layout so that a ray can be tested against all of them at once
+// Unused lanes have zero normals, which makes them parallel to every ray
+typedef struct alignas(32) {
+    float vertexX[TRIANGLE_BLOCK_SIZE];
+    float vertexY[TRIANGLE_BLOCK_SIZE];
+    float vertexZ[TRIANGLE_BLOCK_SIZE];
+    float edge1X[TRIANGLE_BLOCK_SIZE];
+    float edge1Y[TRIANGLE_BLOCK_SIZE];
+    float edge1Z[TRIANGLE_BLOCK_SIZE];
+    float edge2X[TRIANGLE_BLOCK_SIZE];
+    float edge2Y[TRIANGLE_BLOCK_SIZE];
+    float edge2Z[TRIANGLE_BLOCK_SIZE];
+    float normalX[TRIANGLE_BLOCK_SIZE];
+    float normalY[TRIANGLE_BLOCK_SIZE];
+    float normalZ[TRIANGLE_BLOCK_SIZE];
+} TriangleBlock;
+
+void setTriangleBlockLane(TriangleBlock& block, uint32_t lane, const Vector3D& vertex, const Vector3D& edge1, 
+    const Vector3D& edge2, const Vector3D& normal);
+Vector3D getTriangleBlockNormal(const TriangleBlock& block, uint32_t lane);
+
+// Builds the block from shared vertices right before the intersection tests, lane i is the triangle of indices[3*i..3*i+2]
+// Lanes whose three indices are the same are degenerate triangles with zero normals
+void gatherTriangleBlock(const Vector3D* vertices, const uint16_t* indices, TriangleBlock& block);
+
+// Same as above for vertices which are quantized to 16 bits, a vertex is origin + step * its three coordinates
+// It is what the compressed geometry is decoded with, so the triangles are the same as the decoded ones
+void gatherQuantizedTriangleBlock(const uint16_t* coordinates, const Vector3D& origin, float step, const uint16_t* indices, 
+    TriangleBlock& block);
+
+// Returns the lane of the closest triangle that the ray hits in (EPSILON6, far) and sets t, Beta and Gamma of the hit,
+// or -1 if the ray misses all of them
+// Runs the variant of the active CPU path
+int32_t intersectTriangleBlock(const TriangleBlock& block, const Ray& ray, float far, float& t, float& beta, float& gamma);
+
+// Tests the rays of the ray block against the triangle in the lane of the block with the same bounds as the test above
+// Sets fars of the rays which hit it to the distances, writes their Beta and Gamma, and returns a mask of them
+uint32_t intersectRayBlock(const RayBlock& rays, const TriangleBlock& block, uint32_t lane, float* fars, float* betas, float* gammas);
+
+#endif // __TRIANGLE_BLOCK_H__
@@ -0,0 +1,73 @@
+
+#ifndef __ALIGNED_VECTOR3D_H__
+#define __ALIGNED_VECTOR3D_H__
+
+#include "vector3d.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Vector3D padded to 16 bytes with a zero fourth lane, so that it is loaded into an SSE register with one instruction
+// It is meant for the data which a kernel reads many times, such as the edges of a triangle
+class alignas(16) AlignedVector3D : public Vector3D {
+private:
+    float w;
+
+#ifdef __SSE2__
+    AlignedVector3D(__m128 xyzw) {
+        _mm_store_ps(&x, xyzw);
+    }
+
+    __m128 load(void) const {
+        return _mm_load_ps(&x);
+    }
+#endif
+
+public:
+    // The operations of Vector3D are still used when an operand is not aligned
+    using Vector3D::operator-;
+    using Vector3D::dot;
+    using Vector3D::cross;
+
+    AlignedVector3D() : Vector3D(), w(0.0f) {}
+    AlignedVector3D(const Vector3D& vector) : Vector3D(vector), w(0.0f) {}
+
+#ifdef __SSE2__
+    AlignedVector3D operator - (const AlignedVector3D& other) const {
+        return AlignedVector3D(_mm_sub_ps(load(), other.load()));
+    }
+
+    float dot(const AlignedVector3D& other) const {
+        const __m128 product = _mm_mul_ps(load(), other.load());
+        const __m128 sum = _mm_add_ps(product, _mm_movehl_ps(product, product)); // (x+z, y+w)
+        return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1))));
+    }
+
+    // Computes the cross product on (y, z, x) rotations of the operands, the fourth lane stays zero
+    AlignedVector3D cross(const AlignedVector3D& other) const {
+        const __m128 a = load();
+        const __m128 b = other.load();
+        const __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+        return AlignedVector3D(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+    }
+#else
+    AlignedVector3D operator - (const AlignedVector3D& other) const {
+        return Vector3D::operator-(other);
+    }
+
+    float dot(const AlignedVector3D& other) const {
+        return Vector3D::dot(other);
+    }
+
+    AlignedVector3D cross(const AlignedVector3D& other) const {
+        return Vector3D::cross(other);
+    }
+#endif
+};
+
+static_assert(sizeof(AlignedVector3D) == 16, "AlignedVector3D must fill an SSE register");
+
+#endif // __ALIGNED_VECTOR3D_H__
@@ -0,0 +1,41 @@
+
+#include "ray_packet.h"
+
+void setRayBlockLane(RayBlock& block, uint32_t lane, const Ray& ray) {
+    assert(lane < RAY_BLOCK_SIZE);
+    block.originX[lane] = ray.origin.x;
+    block.originY[lane] = ray.origin.y;
+    block.originZ[lane] = ray.origin.z;
+    block.dirX[lane] = ray.dir.x;
+    block.dirY[lane] = ray.dir.y;
+    block.dirZ[lane] = ray.dir.z;
+}
+
+Ray getRayBlockLane(const RayBlock& block, uint32_t lane) {
+    assert(lane < RAY_BLOCK_SIZE);
+    return Ray{
+        .origin = Vector3D(block.originX[lane], block.originY[lane], block.originZ[lane]),
+        .dir = Vector3D(block.dirX[lane], block.dirY[lane], block.dirZ[lane]),
+    };
+}
+
+Ray getRayPacketRay(const RayPacket& packet, uint32_t index) {
+    assert(index < RAY_PACKET_SIZE);
+    return getRayBlockLane(packet.blocks[index / RAY_BLOCK_SIZE], index % RAY_BLOCK_SIZE);
+}
+
+// The box is outside if its corner which is the farthest along the normal of a plane is behind that plane
+bool frustumOverlapsAABB(const Frustum& frustum, const Vector3D& minPoint, const Vector3D& maxPoint) {
+    for (uint32_t i = 0; i < 4; i++) {
+        const Vector3D& normal = frustum.planeNormals[i];
+        const Vector3D farthestCorner = Vector3D(
+            (normal.x > 0.0f) ? maxPoint.x : minPoint.x,
+            (normal.y > 0.0f) ? maxPoint.y : minPoint.y,
+            (normal.z > 0.0f) ? maxPoint.z : minPoint.z
+        );
+        if (normal.dot(farthestCorner - frustum.apex) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+
+#ifndef __RAY_PACKET_H__
+#define __RAY_PACKET_H__
+
+#include <stdint.h>
+#include "vector3d.h"
+
+// A packet is a square of pixels, each of its rows is tested at once
+#define RAY_BLOCK_SIZE    8
+#define RAY_PACKET_HEIGHT 8
+#define RAY_PACKET_SIZE   (RAY_BLOCK_SIZE * RAY_PACKET_HEIGHT)
+
+// Rays in structure-of-arrays layout so that they can be tested against a primitive at once
+typedef struct alignas(32) {
+    float originX[RAY_BLOCK_SIZE];
+    float originY[RAY_BLOCK_SIZE];
+    float originZ[RAY_BLOCK_SIZE];
+    float dirX[RAY_BLOCK_SIZE];
+    float dirY[RAY_BLOCK_SIZE];
+    float dirZ[RAY_BLOCK_SIZE];
+} RayBlock;
+
+// Pyramid with its apex at the common point of the rays, which contains all rays of a packet
+// The planes pass through the apex and their normals point inwards
+typedef struct {
+    Vector3D apex;
+    Vector3D planeNormals[4];
+} Frustum;
+
+// Primary rays of neighbouring pixels, which all pass through the camera position
+// The rays of the pixels outside the image are left zero, their ranges must be empty
+typedef struct {
+    RayBlock blocks[RAY_PACKET_HEIGHT];
+    Frustum frustum;
+    float maxOriginDistance; // Distance from the apex to the farthest ray origin
+} RayPacket;
+
+void setRayBlockLane(RayBlock& block, uint32_t lane, const Ray& ray);
+Ray getRayBlockLane(const RayBlock& block, uint32_t lane);
+
+// Ray i of the packet is in lane i % RAY_BLOCK_SIZE of block i / RAY_BLOCK_SIZE
+Ray getRayPacketRay(const RayPacket& packet, uint32_t index);
+
+// Returns false only if the box is completely outside the frustum
+bool frustumOverlapsAABB(const Frustum& frustum, const Vector3D& minPoint, const Vector3D& maxPoint);
+
+#endif // __RAY_PACKET_H__
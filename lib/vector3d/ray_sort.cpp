@@ -0,0 +1,33 @@
+
+#include "ray_sort.h"
+
+// Puts two zero bits between each bit of the RAY_SORT_CELL_BITS bits of value
+static uint32_t expandBits(uint32_t value) {
+    value = (value * 0x00010001u) & 0xFF0000FFu;
+    value = (value * 0x00000101u) & 0x0F00F00Fu;
+    value = (value * 0x00000011u) & 0xC30C30C3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+// Maps the coordinate in [min, max] to a cell index in [0, 2^RAY_SORT_CELL_BITS)
+static uint32_t findCell(float coordinate, float min, float max) {
+    const uint32_t cellCount = 1 << RAY_SORT_CELL_BITS;
+    const float extent = max - min;
+    if (!(extent > 0.0f)) {
+        return 0;
+    }
+
+    const float cell = (coordinate - min) / extent * cellCount;
+    return (cell <= 0.0f) ? 0 : (cell >= cellCount - 1) ? cellCount - 1 : static_cast<uint32_t>(cell);
+}
+
+uint32_t findRaySortKey(const Ray& ray, const Vector3D& minPoint, const Vector3D& maxPoint) {
+    const uint32_t octant = (ray.dir.x < 0.0f) | ((ray.dir.y < 0.0f) << 1) | ((ray.dir.z < 0.0f) << 2);
+    const uint32_t mortonCode = 
+        (expandBits(findCell(ray.origin.x, minPoint.x, maxPoint.x)) << 2) | 
+        (expandBits(findCell(ray.origin.y, minPoint.y, maxPoint.y)) << 1) | 
+         expandBits(findCell(ray.origin.z, minPoint.z, maxPoint.z));
+
+    return (octant << (3 * RAY_SORT_CELL_BITS)) | mortonCode;
+}
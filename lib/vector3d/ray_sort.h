@@ -0,0 +1,16 @@
+
+#ifndef __RAY_SORT_H__
+#define __RAY_SORT_H__
+
+#include <stdint.h>
+#include "vector3d.h"
+
+// Number of bits of the Morton code per axis
+#define RAY_SORT_CELL_BITS 9
+
+// Key whose top 3 bits are the direction octant of the ray and whose lower bits are the Morton code of the cell
+// that contains its origin, so that sorting by the key puts the rays which start close and go the same way together
+// The origin is quantized in the box between minPoint and maxPoint, points outside are clamped to it
+uint32_t findRaySortKey(const Ray& ray, const Vector3D& minPoint, const Vector3D& maxPoint);
+
+#endif // __RAY_SORT_H__
@@ -27,40 +27,111 @@ public:
     static const Vector3D backward;
     static const Vector3D forward;
 
-    Vector3D();
-    Vector3D(float value);
-    Vector3D(float x_, float y_, float z_);
+    Vector3D() : x(0.0f), y(0.0f), z(0.0f) {}
+    Vector3D(float value) : x(value), y(value), z(value) {}
+    Vector3D(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
     Vector3D(float theta, float phi);
-    
-    Vector3D operator + (const Vector3D& other) const;
-    void operator += (const Vector3D& other);
-    Vector3D operator - (void) const;
-    Vector3D operator - (const Vector3D& other) const;
-    void operator -= (const Vector3D& other);
-    Vector3D operator * (float scalar) const;
-    void operator *= (float scalar);
-    Vector3D operator / (float scalar) const;
-    void operator /= (float scalar);
-
-    Vector3D multiply(const Vector3D& multiplier) const;
-    Vector3D divide(const Vector3D& divisor) const;
-
-    float dot(const Vector3D& other) const;
-    float mag(void) const;
-    float magSquare(void) const;
-
-    void normalized(void);
-    Vector3D normalize(void) const;
-    Vector3D cross(const Vector3D& other) const;
+
+    // The arithmetic is defined in the header, so that it is inlined into the intersection kernels
+    Vector3D operator + (const Vector3D& other) const {
+        return Vector3D(x+other.x, y+other.y, z+other.z);
+    }
+
+    void operator += (const Vector3D& other) {
+        x += other.x;
+        y += other.y;
+        z += other.z;
+    }
+
+    Vector3D operator - (void) const {
+        return Vector3D(-x, -y, -z);
+    }
+
+    Vector3D operator - (const Vector3D& other) const {
+        return Vector3D(x-other.x, y-other.y, z-other.z);
+    }
+
+    void operator -= (const Vector3D& other) {
+        x -= other.x;
+        y -= other.y;
+        z -= other.z;
+    }
+
+    Vector3D operator * (float scalar) const {
+        return Vector3D(x*scalar, y*scalar, z*scalar);
+    }
+
+    void operator *= (float scalar) {
+        x *= scalar;
+        y *= scalar;
+        z *= scalar;
+    }
+
+    // Divisions multiply with the reciprocal, which is computed once
+    Vector3D operator / (float scalar) const {
+        assert(scalar != 0.0f);
+        return *this * (1.0f / scalar);
+    }
+
+    void operator /= (float scalar) {
+        assert(scalar != 0.0f);
+        *this *= 1.0f / scalar;
+    }
+
+    Vector3D multiply(const Vector3D& multiplier) const {
+        return Vector3D(x*multiplier.x, y*multiplier.y, z*multiplier.z);
+    }
+
+    Vector3D divide(const Vector3D& divisor) const {
+        assert(divisor.x != 0.0f);
+        assert(divisor.y != 0.0f);
+        assert(divisor.z != 0.0f);
+
+        return Vector3D(x/divisor.x, y/divisor.y, z/divisor.z);
+    }
+
+    float dot(const Vector3D& other) const {
+        return x*other.x + y*other.y + z*other.z;
+    }
+
+    float mag(void) const {
+        return sqrtf(x*x + y*y + z*z);
+    }
+
+    float magSquare(void) const {
+        return x*x + y*y + z*z;
+    }
+
+    void normalized(void) {
+        *this *= 1.0f / mag();
+    }
+
+    Vector3D normalize(void) const {
+        return *this * (1.0f / mag());
+    }
+
+    Vector3D cross(const Vector3D& other) const {
+        return Vector3D(y*other.z - z*other.y,
+                        z*other.x - x*other.z,
+                        x*other.y - y*other.x);
+    }
 
     void rotateX(float radian);
     void rotateY(float radian);
     void rotateZ(float radian);
     void rotate(float radianX, float radianY, float radianZ);
 
-    static Vector3D projection(const Vector3D& vector, const Vector3D& onto);
-    static Vector3D bisector(const Vector3D& unit1, const Vector3D& unit2);
-    static Vector3D reflection(const Vector3D& unit, const Vector3D& unitNormal);
+    static Vector3D projection(const Vector3D& vector, const Vector3D& onto) {
+        return onto * (onto.dot(vector) / onto.dot(onto));
+    }
+
+    static Vector3D bisector(const Vector3D& unit1, const Vector3D& unit2) {
+        return (unit1 + unit2).normalize();
+    }
+
+    static Vector3D reflection(const Vector3D& unit, const Vector3D& unitNormal) {
+        return unitNormal * 2.0f * unitNormal.dot(unit) - unit;
+    }
 };
 
 typedef struct {
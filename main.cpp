@@ -1,9 +1,13 @@
 
 #include <iostream>
 #include <fstream>
-#include <thread>
 #include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
 #include <stb_image_write.h>
+#include <linear_color.h>
+#include <ray_sort.h>
 
 #include <point_light.h>
 #include <directional_light.h>
@@ -11,27 +15,103 @@
 
 #include <camera.h>
 #include <sphere.h>
+#include <aabb.h>
 #include <bezier.h>
 #include <mesh.h>
+#include <bvh.h>
+#include <scheduler.h>
+#include <cpu.h>
 
 #define MAX_RECURSIVE_RAY_TRACING_DEPTH 6UL
-#define MAX_SHAPE_COUNT 100UL
 #define MIN_ENERGY_DENSITY (1.0f/255.0f)
 
+// Secondary rays with less energy density than this enter the Russian roulette when it is enabled
+#define RUSSIAN_ROULETTE_ENERGY_DENSITY 0.25f
+
+// Each depth leaves at most one of its two secondary rays on the stack while the other one is traced
+#define RAY_STACK_SIZE (MAX_RECURSIVE_RAY_TRACING_DEPTH + 1)
+
 #define IMAGE_HEIGHT  840UL
 #define IMAGE_WIDTH   840UL
 
-#define THREAD_NUMBER 12UL
-#define WIDTH_PER_THREAD (IMAGE_WIDTH/THREAD_NUMBER)
-
 const float GROUND_LEVEL = -50.0f;
 const Color& AMBIENT_COLOR = Color::White;
 const Color& BACKGROUND_COLOR = Color::Black;
 
-Color image[IMAGE_HEIGHT * IMAGE_WIDTH] = {BACKGROUND_COLOR};
-
-Shape* shapes[MAX_SHAPE_COUNT];
-uint32_t shapeNumber = 0;
+// Shading is accumulated in linear colors, which are quantized into the image once rendering is finished
+LinearColor hdrImage[IMAGE_HEIGHT * IMAGE_WIDTH];
+Color image[IMAGE_HEIGHT * IMAGE_WIDTH];
+
+// How the Bezier surfaces of the teapot are stored and intersected
+typedef enum {
+    GEOMETRY_TESSELLATED, // Triangles on shared vertices, which are gathered into SIMD blocks before the intersection tests
+    GEOMETRY_COMPRESSED,  // Triangles with quantized vertices, which are decoded before the intersection tests
+    GEOMETRY_EXACT,       // Control points, which are intersected by Newton iterations
+} GeometryMode;
+
+// Optional limits on the secondary rays, both are disabled by default since they change the image
+typedef struct {
+    bool russianRoulette; // Terminate low energy rays randomly and scale the energy of the survivors up
+    uint32_t rayBudget;   // Maximum number of rays traced for a pixel, 0 for no limit
+} RayTerminationOptions;
+
+RayTerminationOptions rayTerminationOptions = {.russianRoulette = false, .rayBudget = 0};
+
+// Random state and ray count of the pixel whose rays are being traced
+// The state is seeded by the position of the pixel, so that the image does not depend on the scheduling
+typedef struct {
+    uint32_t randomState;
+    uint32_t rayCount;
+} PixelRays;
+
+typedef struct {
+    uint64_t tracedRayCount;
+    uint64_t rouletteTerminatedRayCount;
+    uint64_t budgetTerminatedRayCount;
+} RayTerminationStats;
+
+// Ray which waits on the stack of traceRay
+typedef struct {
+    Ray ray;
+    float refractiveIndex; // Refractive index of the medium in which the ray travels
+    float energyDensity;
+    uint32_t depthCount;
+} PendingRay;
+
+// Ray which waits in the queue of its depth in the wavefront mode
+typedef struct {
+    Ray ray;
+    uint32_t pixelIndex;   // Index of the pixel in the tile that the ray contributes to
+    float refractiveIndex; // Refractive index of the medium in which the ray travels
+    float energyDensity;
+} QueuedRay;
+
+// Mean cosine of the angle between the directions of consecutive secondary rays in the queues, 
+// which shows how similar the paths of the rays that are traced one after another are
+typedef struct {
+    double unsortedCoherenceSum;
+    double sortedCoherenceSum;
+    uint64_t rayPairCount;
+} RaySortStats;
+
+// Each thread accumulates the colors of its current tile in its own buffer, 
+// which is copied to the image once the tile is finished, so that threads do not write to the same cache lines
+// The ray queues and the hits are reused between the tiles in the wavefront mode
+typedef struct alignas(64) {
+    std::vector<LinearColor> colors;
+    std::vector<QueuedRay> rayQueue;     // Rays of the current depth
+    std::vector<QueuedRay> nextRayQueue; // Rays of the next depth
+    std::vector<Hit> hits;
+    std::vector<uint64_t> sortKeys; // Sort key of each queued ray in the high half and its index in the queue in the low half
+    std::vector<PixelRays> pixelRays;
+    RaySortStats sortStats;
+    RayTerminationStats terminationStats;
+} TileBuffer;
+
+std::vector<TileBuffer> tileBuffers;
+
+// All shapes of the scene flattened into one mesh, which is built once the teapot is read
+const Mesh* scene = NULL;
 
 /* ----------------------------------------------------------------------*/
 
@@ -135,115 +215,195 @@ const Camera camera = Camera(
 
 /* ----------------------------------------------------------------------*/
 
-void traceRay(const Ray& ray, Color& color, float incomingRefractiveIndex, float energyDensity, uint32_t depthCount) {
-    // If the max recursive depth is exceeded or the energy density is less than a threshold, stop tracing
-    if (depthCount > MAX_RECURSIVE_RAY_TRACING_DEPTH || energyDensity < MIN_ENERGY_DENSITY) {
-        return;
+template <typename Function>
+void shadeHit(const Ray& ray, const Hit& closestHit, LinearColor& color, float incomingRefractiveIndex, float energyDensity, 
+    uint32_t depthCount, Function traceSecondaryRay);
+
+Hit findClosestHit(const Ray& ray) {
+    Hit closestHit = {.t = INFINITY, .shape = NULL};
+
+    // Check whether the ray intersects with a shape, every hit shortens the range for the rest of the shapes
+    // Only the closest hit is recorded during the traversal, its details are computed once afterwards
+    scene->intersect(&closestHit, ray, camera.getFar());
+    return closestHit;
+}
+
+PixelRays startPixelRays(uint32_t x, uint32_t y) {
+    // Hash the position, so that the sequences of neighbouring pixels are not correlated
+    uint32_t seed = (y * IMAGE_WIDTH + x) * 0x9E3779B9U;
+    seed ^= seed >> 16;
+    seed *= 0x85EBCA6BU;
+    seed ^= seed >> 13;
+    return PixelRays{.randomState = seed, .rayCount = 1};
+}
+
+// Returns a random number in [0, 1) from the sequence of the pixel
+float randomFloat(PixelRays& pixelRays) {
+    pixelRays.randomState = pixelRays.randomState * 747796405U + 2891336453U;
+    const uint32_t state = pixelRays.randomState;
+    uint32_t word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737U;
+    word = (word >> 22) ^ word;
+    return (word >> 8) * (1.0f / 16777216.0f);
+}
+
+// Decides whether a secondary ray is traced, its energy density may be scaled up if it survives the Russian roulette
+// A ray with energy density e survives the roulette with probability e / RUSSIAN_ROULETTE_ENERGY_DENSITY, 
+// and it then carries RUSSIAN_ROULETTE_ENERGY_DENSITY, so the expected contribution of the ray does not change
+bool continueSecondaryRay(uint32_t depthCount, float& energyDensity, PixelRays& pixelRays, RayTerminationStats& stats) {
+    if (depthCount > MAX_RECURSIVE_RAY_TRACING_DEPTH) {
+        return false;
     }
 
-    Intersect closestIntersect = {.t = INFINITY};
-    Intersect currentIntersect;
-    Shape* closestShape = NULL;
-    Shape* currentShape;
+    if (rayTerminationOptions.rayBudget > 0 && pixelRays.rayCount >= rayTerminationOptions.rayBudget) {
+        stats.budgetTerminatedRayCount++;
+        return false;
+    }
 
-    // Check whether the ray intersects with a shape
-    for (uint32_t i = 0; i < shapeNumber; i++) {
-        if (shapes[i]->intersect(&currentIntersect, &currentShape, ray, camera.getFar()) && currentIntersect.t < closestIntersect.t) {
-            closestIntersect = currentIntersect;
-            closestShape = currentShape;
+    if (rayTerminationOptions.russianRoulette && energyDensity < RUSSIAN_ROULETTE_ENERGY_DENSITY) {
+        const float survivalProbability = energyDensity / RUSSIAN_ROULETTE_ENERGY_DENSITY;
+        if (randomFloat(pixelRays) >= survivalProbability) {
+            stats.rouletteTerminatedRayCount++;
+            return false;
         }
+        energyDensity = RUSSIAN_ROULETTE_ENERGY_DENSITY;
+    } else if (energyDensity < MIN_ENERGY_DENSITY) {
+        return false;
     }
 
-    // Check if the ray hits to an object
-    if (closestShape != NULL) {
-        // Add the ambient lighting once
-        if (depthCount == 1) {
-            color += AMBIENT_COLOR * AMBIENT_COEF;
-        }
+    pixelRays.rayCount++;
+    stats.tracedRayCount++;
+    return true;
+}
 
-        for (uint32_t i = 0; i < lightNumber; i++) {
-            const LightInfo lightInfo = lights[i]->shine(closestIntersect.hitLocation);
-            if (lightInfo.distance == -INFINITY) { // Light does not hit to the hit location
-                continue;
-            }
-            
-            const Ray shadowRay = {
-                .origin = closestIntersect.hitLocation + closestIntersect.normal * EPSILON3,
-                .dir = lightInfo.directionToLight,
-            };
+// Traces the ray and the reflective and refractive rays that it spawns depth first without recursion
+// The pending rays are kept on a fixed-size stack of the calling thread
+void traceRay(const Ray& ray, LinearColor& color, float incomingRefractiveIndex, float energyDensity, uint32_t depthCount, 
+    PixelRays& pixelRays, RayTerminationStats& stats) {
+    PendingRay stack[RAY_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = PendingRay{
+        .ray = ray, 
+        .refractiveIndex = incomingRefractiveIndex, 
+        .energyDensity = energyDensity, 
+        .depthCount = depthCount,
+    };
 
-            // Check if a shape casts a shadow onto the point
-            Shape* shadowingShape = NULL;
-            float leastShadowingShapeTransparency = WORLD_TRANSPARENCY;
-            for (uint32_t j = 0; j < shapeNumber; j++) {
-                if (shapes[j]->intersect(NULL, &shadowingShape, shadowRay, lightInfo.distance) && 
-                    shadowingShape->getTransparency() < leastShadowingShapeTransparency) {
-                    leastShadowingShapeTransparency = shadowingShape->getTransparency();
-                }
-            }
+    LinearColor accumulatedColor;
+    while (stackSize > 0) {
+        const PendingRay pendingRay = stack[--stackSize];
 
-            // Calculate diffuse and specular light intensity
-            const float diffuse = DIFFUSE_COEF * greater(lightInfo.directionToLight.dot(closestIntersect.normal), 0.0f);
-            const Vector3D bisector = Vector3D::bisector(lightInfo.directionToLight, -ray.dir);
-            const float specular = SPECULAR_COEF * powf(greater(bisector.dot(closestIntersect.normal), 0.0f), SPECULAR_POW);
-                        
-            // Update the color
-            color += closestShape->getColor() * lights[i]->getColor()
-                * ((diffuse + specular) 
-                * lightInfo.intensity                         // As intensity of the light increases, the point looks brighter
-                * energyDensity                               // As the reflectivity and the transparency of the previous shape increases, the current object gets more visible
-                * leastShadowingShapeTransparency             // If an object casts shadow onto the point, the point looks dimmer
-                * (1.0f - closestShape->getTransparency()     // As the transparency of the shape increases, its color gets less visible
-                        - closestShape->getReflectivity()));  // As the reflectivity of the shape increases, its color gets less visible
+        // If the max depth is exceeded or the energy density is less than a threshold, stop tracing
+        // Only the first ray is checked here, the secondary rays are checked before they are pushed
+        if (pendingRay.depthCount > MAX_RECURSIVE_RAY_TRACING_DEPTH || pendingRay.energyDensity < MIN_ENERGY_DENSITY) {
+            continue;
         }
 
-        float reflectivePortion = closestShape->getReflectivity();
-        if (closestShape->getTransparency() > 0.0f) {
-            const float normalDotComingRayDir = closestIntersect.normal.dot(ray.dir);
-            const float sinComingAngle = sqrtf(1.0f - normalDotComingRayDir * normalDotComingRayDir);
-            const float outgoingRefractiveIndex = 
-                (incomingRefractiveIndex == WORLD_REFRACTIVE_INDEX) ? closestShape->getRefractiveIndex() : WORLD_REFRACTIVE_INDEX;
-            const float outgoingToIncomingRefractiveIndexRatio = outgoingRefractiveIndex / incomingRefractiveIndex;
-
-            // If there is no total reflection, then calculate the refractive ray and call the function recursively
-            if (sinComingAngle < outgoingToIncomingRefractiveIndexRatio) {
-                const Vector3D dirPerpendicularComponentToNormal = ray.dir - closestIntersect.normal * normalDotComingRayDir;
-                const Vector3D refractiveRayDir = 
-                    (-closestIntersect.normal + dirPerpendicularComponentToNormal / outgoingToIncomingRefractiveIndexRatio).normalize();
-                const Ray refractiveRay = {
-                    .origin = closestIntersect.hitLocation + refractiveRayDir * EPSILON3,
-                    .dir = refractiveRayDir,
-                };
-
-                traceRay(
-                    refractiveRay, 
-                    color, 
-                    outgoingRefractiveIndex, 
-                    energyDensity * closestShape->getTransparency(), 
-                    depthCount+1
-                );
-            } else { // A total reflection occurs
-                reflectivePortion += closestShape->getTransparency();
-            }
+        // Check if the ray hits to an object, the secondary rays are traced before the rest of the stack
+        const Hit closestHit = findClosestHit(pendingRay.ray);
+        if (closestHit.shape != NULL) {
+            shadeHit(pendingRay.ray, closestHit, accumulatedColor, pendingRay.refractiveIndex, pendingRay.energyDensity, 
+                pendingRay.depthCount, [&](const Ray& secondaryRay, float refractiveIndex, float secondaryEnergyDensity) {
+                    if (!continueSecondaryRay(pendingRay.depthCount+1, secondaryEnergyDensity, pixelRays, stats)) {
+                        return;
+                    }
+
+                    assert(stackSize < RAY_STACK_SIZE);
+                    stack[stackSize++] = PendingRay{
+                        .ray = secondaryRay, 
+                        .refractiveIndex = refractiveIndex, 
+                        .energyDensity = secondaryEnergyDensity, 
+                        .depthCount = pendingRay.depthCount+1,
+                    };
+                });
+        }
+    }
+
+    color += accumulatedColor;
+}
+
+// Adds the lighting at the closest hit of the ray to the color
+// The reflective and refractive rays are passed to traceSecondaryRay(ray, refractiveIndex, energyDensity)
+template <typename Function>
+void shadeHit(const Ray& ray, const Hit& closestHit, LinearColor& color, float incomingRefractiveIndex, float energyDensity, 
+    uint32_t depthCount, Function traceSecondaryRay) {
+    const Shape* closestShape = closestHit.shape;
+    const Intersect closestIntersect = closestShape->getIntersect(closestHit, ray);
+    const Material& material = closestShape->getMaterial(); // Looked up once from the shared table
+
+    // Add the ambient lighting once
+    if (depthCount == 1) {
+        color += LinearColor(AMBIENT_COLOR) * AMBIENT_COEF;
+    }
+
+    for (uint32_t i = 0; i < lightNumber; i++) {
+        const LightInfo lightInfo = lights[i]->shine(closestIntersect.hitLocation);
+        if (lightInfo.distance == -INFINITY) { // Light does not hit to the hit location
+            continue;
         }
+        
+        const Ray shadowRay = {
+            .origin = closestIntersect.hitLocation + closestIntersect.normal * EPSILON3,
+            .dir = lightInfo.directionToLight,
+        };
+
+        // Check if a shape casts a shadow onto the point, an opaque shape ends the search
+        float leastShadowingShapeTransparency = WORLD_TRANSPARENCY;
+        scene->traverseOccluders(shadowRay, lightInfo.distance, [&](const Shape* shadowingShape) {
+            if (shadowingShape->getTransparency() < leastShadowingShapeTransparency) {
+                leastShadowingShapeTransparency = shadowingShape->getTransparency();
+            }
+            return leastShadowingShapeTransparency <= 0.0f;
+        });
+
+        // Calculate diffuse and specular light intensity
+        const float diffuse = DIFFUSE_COEF * greater(lightInfo.directionToLight.dot(closestIntersect.normal), 0.0f);
+        const Vector3D bisector = Vector3D::bisector(lightInfo.directionToLight, -ray.dir);
+        const float specular = SPECULAR_COEF * powf(greater(bisector.dot(closestIntersect.normal), 0.0f), SPECULAR_POW);
+                    
+        // Update the color
+        color += LinearColor(*material.color) * LinearColor(lights[i]->getColor())
+            * ((diffuse + specular) 
+            * lightInfo.intensity                         // As intensity of the light increases, the point looks brighter
+            * energyDensity                               // As the reflectivity and the transparency of the previous shape increases, the current object gets more visible
+            * leastShadowingShapeTransparency             // If an object casts shadow onto the point, the point looks dimmer
+            * (1.0f - material.transparency               // As the transparency of the shape increases, its color gets less visible
+                    - material.reflectivity));            // As the reflectivity of the shape increases, its color gets less visible
+    }
 
-        // If the ray reflects from the point, then calculat the refleective ray and call the function recursively
-        if (reflectivePortion > 0.0f) {
-            const Vector3D reflectiveDir = Vector3D::reflection(-ray.dir, closestIntersect.normal);
-            const Ray reflectiveRay = {
-                .origin = closestIntersect.hitLocation + reflectiveDir * EPSILON3,
-                .dir = reflectiveDir,
+    float reflectivePortion = material.reflectivity;
+    if (material.transparency > 0.0f) {
+        const float normalDotComingRayDir = closestIntersect.normal.dot(ray.dir);
+        const float sinComingAngle = sqrtf(1.0f - normalDotComingRayDir * normalDotComingRayDir);
+        const float outgoingRefractiveIndex = 
+            (incomingRefractiveIndex == WORLD_REFRACTIVE_INDEX) ? material.refractiveIndex : WORLD_REFRACTIVE_INDEX;
+        const float outgoingToIncomingRefractiveIndexRatio = outgoingRefractiveIndex / incomingRefractiveIndex;
+
+        // If there is no total reflection, then calculate the refractive ray and trace it
+        if (sinComingAngle < outgoingToIncomingRefractiveIndexRatio) {
+            const Vector3D dirPerpendicularComponentToNormal = ray.dir - closestIntersect.normal * normalDotComingRayDir;
+            const Vector3D refractiveRayDir = 
+                (-closestIntersect.normal + dirPerpendicularComponentToNormal / outgoingToIncomingRefractiveIndexRatio).normalize();
+            const Ray refractiveRay = {
+                .origin = closestIntersect.hitLocation + refractiveRayDir * EPSILON3,
+                .dir = refractiveRayDir,
             };
 
-            traceRay(
-                reflectiveRay, 
-                color, 
-                incomingRefractiveIndex, 
-                energyDensity * reflectivePortion,
-                depthCount+1
-            );
+            traceSecondaryRay(refractiveRay, outgoingRefractiveIndex, energyDensity * material.transparency);
+        } else { // A total reflection occurs
+            reflectivePortion += material.transparency;
         }
     }
+
+    // If the ray reflects from the point, then calculat the refleective ray and trace it
+    if (reflectivePortion > 0.0f) {
+        const Vector3D reflectiveDir = Vector3D::reflection(-ray.dir, closestIntersect.normal);
+        const Ray reflectiveRay = {
+            .origin = closestIntersect.hitLocation + reflectiveDir * EPSILON3,
+            .dir = reflectiveDir,
+        };
+
+        traceSecondaryRay(reflectiveRay, incomingRefractiveIndex, energyDensity * reflectivePortion);
+    }
 }
 
 // Reads the cubic beziers and returns them in a vector
@@ -267,31 +427,242 @@ std::vector<Vector3D> readCubicBezierVertices(const char* filename) {
     return data;
 }
 
-// The function which renders a portion of the image
-void threadFunction(uint32_t index) {
-    const float dx = 1.0f / WIDTH_PER_THREAD;
+// Copies the finished tile to the image row by row
+void copyTileToImage(const Tile& tile, const std::vector<LinearColor>& tileColors) {
+    const uint32_t tileWidth = tile.endX - tile.startX;
+    for (uint32_t j = tile.startY; j < tile.endY; j++) {
+        const uint32_t first = (j - tile.startY) * tileWidth;
+        std::copy(tileColors.begin() + first, tileColors.begin() + first + tileWidth, hdrImage + j*IMAGE_WIDTH + tile.startX);
+    }
+}
+
+// The function which renders the pixels of a tile
+void renderTile(const Tile& tile, uint32_t threadIndex) {
+    const uint32_t tileWidth = tile.endX - tile.startX;
+    const uint32_t tileHeight = tile.endY - tile.startY;
+
+    std::vector<LinearColor>& tileColors = tileBuffers[threadIndex].colors;
+    RayTerminationStats& terminationStats = tileBuffers[threadIndex].terminationStats;
+    tileColors.assign(tileWidth * tileHeight, LinearColor(BACKGROUND_COLOR));
+
+    Vector3D sceneMinPoint;
+    Vector3D sceneMaxPoint;
+    scene->findAABBMinMaxPoints(sceneMinPoint, sceneMaxPoint);
+
+    // Primary rays are traced in packets of neighbouring pixels, the secondary rays one by one
+    for (uint32_t packetY = 0; packetY < tileHeight; packetY += RAY_PACKET_HEIGHT) { // y axis
+        for (uint32_t packetX = 0; packetX < tileWidth; packetX += RAY_BLOCK_SIZE) { // x axis
+            const uint32_t packetWidth = smaller(tileWidth - packetX, RAY_BLOCK_SIZE);
+            const uint32_t packetHeight = smaller(tileHeight - packetY, RAY_PACKET_HEIGHT);
+            const RayPacket packet = camera.generateRayPacket(tile.startX+packetX, tile.startY+packetY, IMAGE_WIDTH, IMAGE_HEIGHT, 
+                packetWidth, packetHeight);
+
+            // The pixels keep the background color if the packet misses the whole scene
+            if (!frustumOverlapsAABB(packet.frustum, sceneMinPoint, sceneMaxPoint)) {
+                continue;
+            }
+
+            // The rays of the pixels outside the tile get empty ranges
+            Hit hits[RAY_PACKET_SIZE];
+            float fars[RAY_PACKET_SIZE];
+            for (uint32_t i = 0; i < RAY_PACKET_SIZE; i++) {
+                const bool inTile = i / RAY_BLOCK_SIZE < packetHeight && i % RAY_BLOCK_SIZE < packetWidth;
+                hits[i] = Hit{.t = INFINITY, .shape = NULL};
+                fars[i] = inTile ? camera.getFar() : 0.0f;
+            }
+
+            scene->intersectPacket(hits, fars, packet);
+
+            for (uint32_t i = 0; i < RAY_PACKET_SIZE; i++) {
+                if (hits[i].shape != NULL) {
+                    const uint32_t pixelX = packetX + i%RAY_BLOCK_SIZE;
+                    const uint32_t pixelY = packetY + i/RAY_BLOCK_SIZE;
+                    LinearColor& color = tileColors[pixelY*tileWidth + pixelX];
+                    PixelRays pixelRays = startPixelRays(tile.startX+pixelX, tile.startY+pixelY);
+                    shadeHit(getRayPacketRay(packet, i), hits[i], color, WORLD_REFRACTIVE_INDEX, 1.0f, 1, 
+                        [&](const Ray& secondaryRay, float refractiveIndex, float secondaryEnergyDensity) {
+                            if (continueSecondaryRay(2, secondaryEnergyDensity, pixelRays, terminationStats)) {
+                                traceRay(secondaryRay, color, refractiveIndex, secondaryEnergyDensity, 2, pixelRays, terminationStats);
+                            }
+                        });
+                }
+            }
+        }
+    }
+
+    copyTileToImage(tile, tileColors);
+}
+
+// Returns the sum of the cosines of the angles between the directions of consecutive rays in the queue
+double sumRayCoherence(const std::vector<QueuedRay>& rayQueue) {
+    double coherenceSum = 0.0;
+    for (uint32_t i = 1; i < rayQueue.size(); i++) {
+        coherenceSum += rayQueue[i-1].ray.dir.dot(rayQueue[i].ray.dir);
+    }
+    return coherenceSum;
+}
+
+// Reorders the queue by the direction octants and the origin cells of the rays, 
+// so that the rays which take similar paths through the hierarchy are traced one after another
+void sortRayQueue(TileBuffer& buffer, const Vector3D& sceneMinPoint, const Vector3D& sceneMaxPoint) {
+    const uint32_t rayCount = buffer.rayQueue.size();
+    if (rayCount < 2) {
+        return;
+    }
+
+    buffer.sortKeys.resize(rayCount);
+    for (uint32_t i = 0; i < rayCount; i++) {
+        buffer.sortKeys[i] = ((uint64_t)findRaySortKey(buffer.rayQueue[i].ray, sceneMinPoint, sceneMaxPoint) << 32) | i;
+    }
+    std::sort(buffer.sortKeys.begin(), buffer.sortKeys.end());
+
+    // The next queue is not used until the shading pass, so it is the scratch buffer of the sort
+    buffer.nextRayQueue.resize(rayCount);
+    for (uint32_t i = 0; i < rayCount; i++) {
+        buffer.nextRayQueue[i] = buffer.rayQueue[buffer.sortKeys[i] & UINT32_MAX];
+    }
+
+    buffer.sortStats.unsortedCoherenceSum += sumRayCoherence(buffer.rayQueue);
+    buffer.sortStats.sortedCoherenceSum += sumRayCoherence(buffer.nextRayQueue);
+    buffer.sortStats.rayPairCount += rayCount - 1;
+    std::swap(buffer.rayQueue, buffer.nextRayQueue);
+}
+
+// Renders the pixels of a tile breadth first, all rays of a depth are intersected before any of them is shaded
+// The shading pushes the secondary rays which are still worth tracing to the queue of the next depth
+void renderTileWavefront(const Tile& tile, uint32_t threadIndex) {
+    const float dx = 1.0f / IMAGE_WIDTH;
     const float dy = 1.0f / IMAGE_HEIGHT;
-    float x = (index+0.5f) / IMAGE_WIDTH;
-
-    for (uint32_t i = 0; i < WIDTH_PER_THREAD; i++) { // x axis
-        uint32_t colorIndex = index + i*THREAD_NUMBER;
-        float y = 1.0f - dy / 2.0f;
-        for (uint32_t j = 0; j < IMAGE_HEIGHT; j++) { // y axis     
-            const Ray ray = camera.generateRay(x, y);
-            Color& color = image[colorIndex];
-            traceRay(ray, color, WORLD_REFRACTIVE_INDEX, 1.0f, 1);
-
-            colorIndex += IMAGE_WIDTH;
-            y -= dy;
+    const uint32_t tileWidth = tile.endX - tile.startX;
+    const uint32_t tileHeight = tile.endY - tile.startY;
+
+    TileBuffer& buffer = tileBuffers[threadIndex];
+    buffer.colors.assign(tileWidth * tileHeight, LinearColor(BACKGROUND_COLOR));
+    buffer.rayQueue.clear();
+    buffer.pixelRays.clear();
+
+    for (uint32_t j = 0; j < tileHeight; j++) { // y axis
+        const float y = 1.0f - (tile.startY+j+0.5f) * dy;
+        for (uint32_t i = 0; i < tileWidth; i++) { // x axis
+            const float x = (tile.startX+i+0.5f) * dx;
+            buffer.pixelRays.push_back(startPixelRays(tile.startX+i, tile.startY+j));
+            buffer.rayQueue.push_back(QueuedRay{
+                .ray = camera.generateRay(x, y),
+                .pixelIndex = j*tileWidth + i,
+                .refractiveIndex = WORLD_REFRACTIVE_INDEX,
+                .energyDensity = 1.0f,
+            });
+        }
+    }
+
+    Vector3D sceneMinPoint;
+    Vector3D sceneMaxPoint;
+    scene->findAABBMinMaxPoints(sceneMinPoint, sceneMaxPoint);
+
+    for (uint32_t depthCount = 1; !buffer.rayQueue.empty(); depthCount++) {
+        // Primary rays are already ordered by their pixels
+        if (depthCount > 1) {
+            sortRayQueue(buffer, sceneMinPoint, sceneMaxPoint);
+        }
+
+        const uint32_t rayCount = buffer.rayQueue.size();
+        buffer.hits.resize(rayCount);
+        for (uint32_t i = 0; i < rayCount; i++) {
+            buffer.hits[i] = findClosestHit(buffer.rayQueue[i].ray);
+        }
+
+        // Only the rays which pass the depth, energy and termination limits are queued, so the next queue is already compacted
+        buffer.nextRayQueue.clear();
+        for (uint32_t i = 0; i < rayCount; i++) {
+            const QueuedRay& queuedRay = buffer.rayQueue[i];
+            if (buffer.hits[i].shape == NULL) {
+                continue;
+            }
+
+            shadeHit(queuedRay.ray, buffer.hits[i], buffer.colors[queuedRay.pixelIndex], queuedRay.refractiveIndex, 
+                queuedRay.energyDensity, depthCount, [&](const Ray& secondaryRay, float refractiveIndex, float secondaryEnergyDensity) {
+                    if (continueSecondaryRay(depthCount+1, secondaryEnergyDensity, buffer.pixelRays[queuedRay.pixelIndex], 
+                        buffer.terminationStats)) {
+                        buffer.nextRayQueue.push_back(QueuedRay{
+                            .ray = secondaryRay,
+                            .pixelIndex = queuedRay.pixelIndex,
+                            .refractiveIndex = refractiveIndex,
+                            .energyDensity = secondaryEnergyDensity,
+                        });
+                    }
+                });
+        }
+        std::swap(buffer.rayQueue, buffer.nextRayQueue);
+    }
+
+    copyTileToImage(tile, buffer.colors);
+}
+
+// Reads the optional thread count (-t), tile size (-s), CPU path (-c), wavefront mode (-w), 
+// Russian roulette (-r), ray budget per pixel (-b), compressed geometry (-q) and exact geometry (-e) arguments
+bool parseArguments(int argc, char **argv, uint32_t& threadCount, uint32_t& tileSize, CPUPath& cpuPath, bool& wavefront, 
+    RayTerminationOptions& terminationOptions, GeometryMode& geometryMode) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0) {
+            wavefront = true;
+            continue;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            geometryMode = GEOMETRY_COMPRESSED;
+            continue;
+        } else if (strcmp(argv[i], "-e") == 0) {
+            geometryMode = GEOMETRY_EXACT;
+            continue;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            terminationOptions.russianRoulette = true;
+            continue;
+        } else if (i+1 >= argc) {
+            return false;
         }
-        x += dx;
+
+        const char* value = argv[i+1];
+        if (strcmp(argv[i], "-c") == 0) {
+            if (!parseCPUPath(value, cpuPath)) {
+                return false;
+            }
+        } else if (atoi(value) <= 0) {
+            return false;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            threadCount = atoi(value);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            tileSize = atoi(value);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            terminationOptions.rayBudget = atoi(value);
+        } else {
+            return false;
+        }
+        i++;
     }
+    return true;
 }
 
 int main(int argc, char **argv) {
     // Start timing
     std::chrono::_V2::system_clock::time_point start = std::chrono::high_resolution_clock::now();
 
+    uint32_t threadCount = TileScheduler::getHardwareThreadCount();
+    uint32_t tileSize = SCHEDULER_DEFAULT_TILE_SIZE;
+    CPUPath cpuPath = detectCPUPath();
+    bool wavefront = false;
+    GeometryMode geometryMode = GEOMETRY_TESSELLATED;
+    if (!parseArguments(argc, argv, threadCount, tileSize, cpuPath, wavefront, rayTerminationOptions, geometryMode)) {
+        std::cerr << "Usage: " << argv[0] << " [-t thread count] [-s tile size] [-c scalar|sse4.2|avx2|avx512] [-w] [-r]" 
+            << " [-b ray budget per pixel] [-q|-e]" << std::endl;
+        return 1;
+    }
+
+    // The path can be forced to a slower one for benchmarking, but not to one that the CPU does not support
+    if (!setCPUPath(cpuPath)) {
+        std::cerr << "The CPU does not support the " << getCPUPathName(cpuPath) << " path, the best one is " 
+            << getCPUPathName(detectCPUPath()) << std::endl;
+        return 1;
+    }
+    std::cout << "CPU path: " << getCPUPathName(getCPUPath()) << " (best supported: " << getCPUPathName(detectCPUPath()) << ")" << std::endl;
+
     // Scale, rotate, and translate the cubic bezier vertices that are read from the file
     std::vector<Vector3D> teapotBezierVertices = readCubicBezierVertices("data/utah_teapot_bezier.txt");
     for (uint32_t i = 0; i < teapotBezierVertices.size(); i++) {
@@ -300,116 +671,105 @@ int main(int argc, char **argv) {
         teapotBezierVertices[i] += teapotPosition;
     }
 
-    std::vector<BezierSurface> teapotBodyBezierSurfaces; 
-    for (uint32_t i = 0; i < 12; i++) { // Body
-        teapotBodyBezierSurfaces.push_back( 
-            BezierSurface(
-                teapotBezierVertices.data() + (i << 4), 
-                teapotSubdivision, 
-                teapotColor, 
-                teapotReflectivity, 
-                teapotTransparency, 
-                teapotRefractiveIndex
-            )
-        );
-    }
-    std::vector<Shape*> teapotBodyShapes;
-    for (uint32_t i = 0; i < teapotBodyBezierSurfaces.size(); i++) {
-        teapotBodyShapes.push_back((Shape*)&teapotBodyBezierSurfaces[i]);
-    }
-    const Mesh teapotBody = Mesh(teapotBodyShapes);
-
-    std::vector<BezierSurface> teapotHandleBezierSurfaces; 
-    for (uint32_t i = 12; i < 16; i++) {
-        teapotHandleBezierSurfaces.push_back( 
-            BezierSurface(
-                teapotBezierVertices.data() + (i << 4), 
-                teapotSubdivision, 
-                teapotColor, 
-                teapotReflectivity, 
-                teapotTransparency, 
-                teapotRefractiveIndex
-            )
-        );
-    }
-    std::vector<Shape*> teapotHandleShapes;
-    for (uint32_t i = 0; i < teapotHandleBezierSurfaces.size(); i++) {
-        teapotHandleShapes.push_back((Shape*)&teapotHandleBezierSurfaces[i]);
-    }
-    const Mesh teapotHandle = Mesh(teapotHandleShapes);
-
-    std::vector<BezierSurface> teapotSpoutBezierSurfaces; 
-    for (uint32_t i = 16; i < 20; i++) {
-        teapotSpoutBezierSurfaces.push_back( 
-            BezierSurface(
-                teapotBezierVertices.data() + (i << 4), 
-                teapotSubdivision, 
-                teapotColor, 
-                teapotReflectivity, 
-                teapotTransparency, 
-                teapotRefractiveIndex
-            )
-        );
-    }
-    std::vector<Shape*> teapotSpoutShapes;
-    for (uint32_t i = 0; i < teapotSpoutBezierSurfaces.size(); i++) {
-        teapotSpoutShapes.push_back((Shape*)&teapotSpoutBezierSurfaces[i]);
-    }
-    const Mesh teapotSpout = Mesh(teapotSpoutShapes);
-
-    std::vector<BezierSurface> teapotLidBezierSurfaces; 
-    for (uint32_t i = 20; i < 28; i++) {
-        teapotLidBezierSurfaces.push_back( 
-            BezierSurface(
-                teapotBezierVertices.data() + (i << 4), 
-                teapotSubdivision, 
-                teapotColor, 
-                teapotReflectivity, 
-                teapotTransparency, 
-                teapotRefractiveIndex
-            )
-        );
-    }
-    std::vector<Shape*> teapotLidShapes;
-    for (uint32_t i = 0; i < teapotLidBezierSurfaces.size(); i++) {
-        teapotLidShapes.push_back((Shape*)&teapotLidBezierSurfaces[i]);
-    }
-    const Mesh teapotLid = Mesh(teapotLidShapes);
-
-    const std::vector<Shape*> teapotShapes = {
-        (Shape*)&teapotBody, 
-        (Shape*)&teapotHandle, 
-        (Shape*)&teapotSpout, 
-        (Shape*)&teapotLid,
+    // All patches of the teapot share the quantization step, so their common edges stay closed in the compressed mode
+    const float teapotQuantizationStep = (geometryMode == GEOMETRY_COMPRESSED) ? 
+        BezierSurface::findQuantizationStep(teapotBezierVertices.data(), teapotBezierVertices.size()) : 0.0f;
+
+    // Creates the surface of the teapot patch whose control points start at the given index
+    const auto createTeapotSurface = [&](uint32_t patchIndex) {
+        const Vector3D* controlPoints = teapotBezierVertices.data() + (patchIndex << 4);
+        if (geometryMode == GEOMETRY_EXACT) {
+            return BezierSurface(controlPoints, teapotColor, teapotReflectivity, teapotTransparency, teapotRefractiveIndex);
+        }
+        return BezierSurface(controlPoints, teapotSubdivision, teapotColor, teapotReflectivity, teapotTransparency, 
+            teapotRefractiveIndex, teapotQuantizationStep);
     };
-    const Mesh teapot = Mesh(teapotShapes);
+
+    // The patches of the body, the handle, the spout and the lid are 0-11, 12-15, 16-19 and 20-27
+    // The surfaces are added to the scene directly, whose hierarchy is the only one built over them
+    std::vector<BezierSurface> teapotBezierSurfaces;
+    for (uint32_t i = 0; i < teapotBezierVertices.size() / 16; i++) {
+        teapotBezierSurfaces.push_back(createTeapotSurface(i));
+    }
+
+    uint32_t teapotTriangleCount = 0;
+    uint32_t teapotGeometryByteCount = 0;
+    float teapotMaxQuantizationError = 0.0f;
+    for (const BezierSurface& surface : teapotBezierSurfaces) {
+        teapotTriangleCount += surface.getTriangleCount();
+        teapotGeometryByteCount += surface.getGeometryByteCount();
+        teapotMaxQuantizationError = greater(teapotMaxQuantizationError, surface.getMaxQuantizationError());
+    }
+    if (geometryMode == GEOMETRY_EXACT) {
+        std::cout << "Teapot geometry: exact, " << teapotGeometryByteCount << " bytes of subpatches";
+    } else {
+        std::cout << "Teapot geometry: " << teapotTriangleCount << " triangles, " 
+            << (float)teapotGeometryByteCount / teapotTriangleCount << " bytes per triangle";
+    }
+    if (geometryMode == GEOMETRY_COMPRESSED) {
+        std::cout << ", quantization step " << teapotQuantizationStep << ", max vertex error " << teapotMaxQuantizationError;
+    }
+    std::cout << std::endl;
 
     // Move all shapes to the Shapes vector
+    std::vector<Shape*> shapes;
     for (uint32_t i = 0; i < sizeof(spheres) / sizeof(Sphere); i++) {
-        shapes[shapeNumber++] = ((Shape*)(spheres+i));
+        shapes.push_back((Shape*)(spheres+i));
     }
     for (uint32_t i = 0; i < sizeof(aabbs) / sizeof(AABB); i++) {
-        shapes[shapeNumber++] = ((Shape*)(aabbs+i));
+        shapes.push_back((Shape*)(aabbs+i));
     }
     for (uint32_t i = 0; i < sizeof(triangles) / sizeof(Triangle); i++) {
-        shapes[shapeNumber++] = ((Shape*)(triangles+i));
+        shapes.push_back((Shape*)(triangles+i));
+    }
+    for (uint32_t i = 0; i < teapotBezierSurfaces.size(); i++) {
+        shapes.push_back((Shape*)&teapotBezierSurfaces[i]);
     }
-    shapes[shapeNumber++] = ((Shape*)&teapot);
 
-    std::cout << "Rendering..." << std::endl;
+    // Flatten the shapes into the arrays of their types and build the bounding volume hierarchy over them once
+    const Mesh sceneMesh = Mesh(shapes, threadCount);
+    scene = &sceneMesh;
+    std::cout << "Scene BVH: " << scene->getBVH().getNodeCount() << " nodes, SAH cost " << scene->getBVH().getSAHCost() << std::endl;
 
-    // Start threads
-    std::vector<std::thread> threads(THREAD_NUMBER);
-    for (uint32_t i = 0; i < THREAD_NUMBER; i++) {
-        threads[i] = std::thread(threadFunction, i);
+    std::cout << "Rendering with " << threadCount << " threads and " << tileSize << "x" << tileSize << " tiles" 
+        << (wavefront ? " in the wavefront mode..." : "...") << std::endl;
+
+    tileBuffers = std::vector<TileBuffer>(threadCount);
+    TileScheduler scheduler = TileScheduler(IMAGE_WIDTH, IMAGE_HEIGHT, tileSize, threadCount);
+    scheduler.run(wavefront ? renderTileWavefront : renderTile);
+
+    if (wavefront) {
+        RaySortStats sortStats = {};
+        for (uint32_t i = 0; i < tileBuffers.size(); i++) {
+            sortStats.unsortedCoherenceSum += tileBuffers[i].sortStats.unsortedCoherenceSum;
+            sortStats.sortedCoherenceSum += tileBuffers[i].sortStats.sortedCoherenceSum;
+            sortStats.rayPairCount += tileBuffers[i].sortStats.rayPairCount;
+        }
+        if (sortStats.rayPairCount > 0) {
+            std::cout << "Secondary ray coherence (mean cosine between consecutive rays): " 
+                << sortStats.unsortedCoherenceSum / sortStats.rayPairCount << " unsorted, " 
+                << sortStats.sortedCoherenceSum / sortStats.rayPairCount << " sorted" << std::endl;
+        }
     }
 
-    // Wait until all threads join
-    for (uint32_t i = 0; i < THREAD_NUMBER; i++) {
-        threads[i].join();
+    RayTerminationStats terminationStats = {};
+    for (uint32_t i = 0; i < tileBuffers.size(); i++) {
+        terminationStats.tracedRayCount += tileBuffers[i].terminationStats.tracedRayCount;
+        terminationStats.rouletteTerminatedRayCount += tileBuffers[i].terminationStats.rouletteTerminatedRayCount;
+        terminationStats.budgetTerminatedRayCount += tileBuffers[i].terminationStats.budgetTerminatedRayCount;
+    }
+    std::cout << "Secondary rays: " << terminationStats.tracedRayCount << " traced, " 
+        << terminationStats.rouletteTerminatedRayCount << " terminated by the Russian roulette, " 
+        << terminationStats.budgetTerminatedRayCount << " by the ray budget" << std::endl;
+
+    const std::vector<ThreadStats>& threadStats = scheduler.getThreadStats();
+    for (uint32_t i = 0; i < threadStats.size(); i++) {
+        std::cout << "Thread " << i << ": " << threadStats[i].tileCount << " tiles, busy " << threadStats[i].busySeconds 
+            << " s, idle " << threadStats[i].idleSeconds << " s" << std::endl;
     }
 
-    // Write the image
+    resolveLinearColors(hdrImage, image, IMAGE_HEIGHT * IMAGE_WIDTH);
+
     std::cout << "Writing image.png..." << std::endl;
     stbi_write_png("image.png", IMAGE_WIDTH, IMAGE_HEIGHT, 3, image, sizeof(Color)*IMAGE_WIDTH);
 